@@ -34,6 +34,16 @@
 #include <libgen.h>
 #include <sys/utsname.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <ftw.h>
+#include <pthread.h>
 
 /* Convenience */
 
@@ -140,6 +150,7 @@ enum constants {
   ARCH_LEN = 128,
   MAX_LINES = 2048,
   MAX_ARCHS = 16,
+  MAX_VERSIONS = 32,
   HASH_SIZE = 1024
 };
 
@@ -165,14 +176,23 @@ enum action_type {
   LINT = 0,
   SCRIPTABLE,
   LIST_ARCHS,
-  CLEAR_CACHE
+  CLEAR_CACHE,
+  SAVE_SNAPSHOT
 };
 
+enum engine_type {
+  LEGACY = 0,
+  FAST,
+  DIFF
+};
+
+/* Names live in the string interner, see interned_string() */
 struct symbol {
-  char name[MAX_LEN];
   struct symbol *next;
   size_t linenum;
   enum symbol_type type;
+  unsigned int versions;
+  uint32_t id;
 };
 
 /* Prefix tree */
@@ -183,6 +203,7 @@ struct symbol {
 struct trie_node {
   struct trie_node* children[MAX_CHILDREN];
   int end;
+  unsigned int versions;
 };
 
 static
@@ -195,6 +216,7 @@ create_node() {
 
   memset(&node->children, 0, sizeof(node->children));
   node->end = false;
+  node->versions = 0;
 
   return node;
 }
@@ -212,7 +234,10 @@ insert_command(struct trie_node **root, char* command) {
   }
 
   while (command && *command) {
-    int c = *command++ - '!';
+    int c = (unsigned char)*command++ - '!';
+    if (c < 0 || c >= MAX_CHILDREN) {
+      return NULL;
+    }
 
     if(!node->children[c]) {
       node->children[c] = create_node();
@@ -239,7 +264,10 @@ find_command(struct trie_node *root, const char* command,
   struct trie_node* node = root;
 
   while (command && *command) {
-    int c = *command - '!';
+    int c = (unsigned char)*command - '!';
+    if (c < 0 || c >= MAX_CHILDREN) {
+      return NULL;
+    }
 
     if(!node->children[c]) {
       return NULL;
@@ -323,23 +351,28 @@ load_trie(struct trie_node **trie, FILE *fp, char* buffer,
     char c = '\0';
 
     size_t nread = 0;;
+    int index = -1;
     while ((nread = fread(&c, 1, sizeof(c), fp)) == 1 * sizeof(c)) {
-      if (c != ' ') {
+      index = (unsigned char)c - '!';
+      if (c != ' ' || index < 0 || index >= MAX_CHILDREN) {
         break;
       }
-      len += load_trie(&node->children[c - '!'], fp, buffer, size);
+      len += load_trie(&node->children[index], fp, buffer, size);
     }
     if (nread < 1 * sizeof(c)) {
       wrn("error: fwrite failed ret: %lu error: %s\n", nread, strerror(errno));
-    } else {
-      node->children[c - '!']->end = 1;
+    } else if (index >= 0 && index < MAX_CHILDREN && node->children[index]) {
+      node->children[index]->end = 1;
     }
 
     len += nread;
 
   } else if (buffer) {
     while(size && *buffer != '\0') {
-      int index = *buffer++ - '!';
+      int index = (unsigned char)*buffer++ - '!';
+      if (index < 0 || index >= MAX_CHILDREN) {
+        break;
+      }
       ++len;
 
       *size -= len;
@@ -388,11 +421,32 @@ struct args {
   bool no_warn_undef_var;
   char *gdbfile;
   char *arch;
+  char *metrics_file;
+  char *snapshots[MAX_VERSIONS];
+  size_t nsnapshots;
+  char *gdb_versions;
+  char *snapshot_file;
+  bool git_staged;
+  char *git_rev;
+  char **pathspecs;
+  size_t npathspecs;
+  char *global_unused;
   enum action_type action;
+  enum engine_type engine;
+};
+
+struct version_index {
+  int versions[MAX_VERSIONS];
+  size_t count;
+  unsigned int selected;
+  struct trie_node *cmds;
+  struct hash_map settings;
+  struct hash_map vars;
 };
 
 struct progdata {
   char archlist[MAX_ARCHS][ARCH_LEN];
+  struct version_index vindex;
   struct lines_map linemap;
   struct hash_map defs;
   struct hash_map refs;
@@ -628,6 +682,397 @@ progname(const char *name) {
   return name ? (__progname = name) : __progname;
 }
 
+/* Metrics */
+
+enum rule_type {
+  RULE_UNUSED_FUNC = 0,
+  RULE_UNUSED_VAR,
+  RULE_UNDEF_FUNC,
+  RULE_UNDEF_VAR,
+  RULE_INCOMPAT,
+  NRULES
+};
+
+enum phase_type {
+  PHASE_INTROSPECTION = 0,
+  PHASE_LINT,
+  NPHASES
+};
+
+struct metrics {
+  size_t cache_hits;
+  size_t cache_misses;
+  size_t cache_invalidations;
+  size_t gdb_spawns;
+  atomic_size_t bytes;
+  atomic_size_t lines;
+  size_t diagnostics[NRULES];
+  double durations[NPHASES];
+};
+
+struct metric_series {
+  const char *family;
+  const char *type;
+  const char *help;
+  char sample[128];
+  double value;
+};
+
+#define MAX_SERIES 64
+
+static
+inline
+struct metrics*
+metrics(void) {
+  static struct metrics __metrics = { 0 };
+  return &__metrics;
+}
+
+static
+double
+monotonic_time(void) {
+  struct timespec ts = { 0 };
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static
+FILE*
+spawn_gdb(const char *cmd) {
+  ++metrics()->gdb_spawns;
+  return popen(cmd, "r");
+}
+
+static
+size_t
+add_series(struct metric_series *series, size_t n, const char *family,
+    const char *type, const char *help, double value, const char *fmt, ...) {
+
+  if (n >= MAX_SERIES) {
+    return n;
+  }
+
+  va_list ap;
+
+  series[n].family = family;
+  series[n].type = type;
+  series[n].help = help;
+  series[n].value = value;
+
+  va_start(ap, fmt);
+  vsnprintf(series[n].sample, sizeof(series[n].sample), fmt, ap);
+  va_end(ap);
+
+  return n + 1;
+}
+
+/* Series of a single run, in the order they are written */
+static
+size_t
+metrics_series(struct metrics *m, struct metric_series *series) {
+  static const char *rules[NRULES] = {
+    "unused-function", "unused-variable",
+    "undefined-function", "undefined-variable",
+    "incompatible-version"
+  };
+  static const char *phases[NPHASES] = { "introspection", "lint" };
+  static const double buckets[] = {
+    0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10
+  };
+
+  size_t n = 0;
+
+  n = add_series(series, n, "gdblint_runs_total", "counter",
+      "Number of gdblint runs", 1, "gdblint_runs_total");
+  n = add_series(series, n, "gdblint_cache_hits_total", "counter",
+      "Runs which loaded gdb data from the cache", m->cache_hits,
+      "gdblint_cache_hits_total");
+  n = add_series(series, n, "gdblint_cache_misses_total", "counter",
+      "Runs which found no gdb data in the cache", m->cache_misses,
+      "gdblint_cache_misses_total");
+  n = add_series(series, n, "gdblint_cache_invalidations_total", "counter",
+      "Number of times the cache has been cleared", m->cache_invalidations,
+      "gdblint_cache_invalidations_total");
+  n = add_series(series, n, "gdblint_gdb_spawns_total", "counter",
+      "Number of gdb processes spawned", m->gdb_spawns,
+      "gdblint_gdb_spawns_total");
+  n = add_series(series, n, "gdblint_linted_bytes_total", "counter",
+      "Number of bytes linted", m->bytes, "gdblint_linted_bytes_total");
+  n = add_series(series, n, "gdblint_linted_lines_total", "counter",
+      "Number of lines linted", m->lines, "gdblint_linted_lines_total");
+
+  for (size_t i = 0; i < NRULES; ++i) {
+    n = add_series(series, n, "gdblint_diagnostics_total", "counter",
+        "Number of diagnostics reported by rule", m->diagnostics[i],
+        "gdblint_diagnostics_total{rule=\"%s\"}", rules[i]);
+  }
+
+  for (size_t i = 0; i < NPHASES; ++i) {
+    double duration = m->durations[i];
+
+    for (size_t j = 0; j < sizeof(buckets) / sizeof(buckets[0]); ++j) {
+      n = add_series(series, n, "gdblint_phase_duration_seconds", "histogram",
+          "Duration of the introspection and lint phases",
+          duration <= buckets[j],
+          "gdblint_phase_duration_seconds_bucket{phase=\"%s\",le=\"%g\"}",
+          phases[i], buckets[j]);
+    }
+    n = add_series(series, n, "gdblint_phase_duration_seconds", "histogram",
+        "Duration of the introspection and lint phases", 1,
+        "gdblint_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"}",
+        phases[i]);
+    n = add_series(series, n, "gdblint_phase_duration_seconds", "histogram",
+        "Duration of the introspection and lint phases", duration,
+        "gdblint_phase_duration_seconds_sum{phase=\"%s\"}", phases[i]);
+    n = add_series(series, n, "gdblint_phase_duration_seconds", "histogram",
+        "Duration of the introspection and lint phases", 1,
+        "gdblint_phase_duration_seconds_count{phase=\"%s\"}", phases[i]);
+  }
+
+  return n;
+}
+
+/* Add the values of the samples in fp to the matching series */
+static
+void
+merge_series(struct metric_series *series, size_t n, FILE *fp) {
+  char line[MAX_LEN];
+
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#') {
+      continue;
+    }
+
+    char *value = strrchr(line, ' ');
+    if (!value) {
+      continue;
+    }
+    *value++ = '\0';
+
+    for (size_t i = 0; i < n; ++i) {
+      if (!strcmp(series[i].sample, line)) {
+        series[i].value += strtod(value, NULL);
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Merge the metrics of this run into a Prometheus text format file, as read by
+ * the node_exporter textfile collector. Writers are serialized by a lock file and
+ * the file is replaced atomically, so readers never see partial output.
+ */
+static
+bool
+write_metrics(const char *path) {
+  if (!path) {
+    return false;
+  }
+
+  struct metric_series series[MAX_SERIES];
+  size_t n = metrics_series(metrics(), series);
+
+  char lockpath[PATH_MAX];
+  char tmppath[PATH_MAX];
+
+  snprintf(lockpath, sizeof(lockpath), "%s.lock", path);
+  snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+
+  int lockfd = open(lockpath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lockfd < 0) {
+    err("open failed for path: %s error: %s\n", lockpath, strerror(errno));
+    return false;
+  }
+
+  if (flock(lockfd, LOCK_EX)) {
+    err("flock failed for path: %s error: %s\n", lockpath, strerror(errno));
+    close(lockfd);
+    return false;
+  }
+
+  FILE *fp = fopen(path, "r");
+  if (fp) {
+    merge_series(series, n, fp);
+    fclose(fp);
+  } else if (errno != ENOENT) {
+    wrn("fopen failed for path: %s error: %s\n", path, strerror(errno));
+  }
+
+  bool ret = false;
+
+  do {
+    int fd = mkstemp(tmppath);
+    if (fd < 0) {
+      err("mkstemp failed for path: %s error: %s\n", tmppath, strerror(errno));
+      break;
+    }
+
+    fchmod(fd, 0644);
+
+    fp = fdopen(fd, "w");
+    if (!fp) {
+      err("fdopen failed: %s\n", strerror(errno));
+      close(fd);
+      unlink(tmppath);
+      break;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      if (!i || strcmp(series[i].family, series[i - 1].family)) {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", series[i].family,
+            series[i].help, series[i].family, series[i].type);
+      }
+      fprintf(fp, "%s %.17g\n", series[i].sample, series[i].value);
+    }
+
+    if (fclose(fp) || rename(tmppath, path)) {
+      err("failed to write path: %s error: %s\n", path, strerror(errno));
+      unlink(tmppath);
+      break;
+    }
+
+    ret = true;
+
+  } while (0);
+
+  flock(lockfd, LOCK_UN);
+  close(lockfd);
+
+  return ret;
+}
+
+/* String interner */
+
+/*
+ * Insert-only open addressing table over an append-only arena, shared by all
+ * threads without locks. The id of a string is its offset in the arena, so it
+ * is stable for the lifetime of the process. Id 0 means "not interned".
+ *
+ * The table stops accepting strings at three quarters load so that probe
+ * sequences stay short. Both arrays live in bss, only the pages touched by
+ * interned names are ever backed by memory.
+ */
+
+enum intern_constants {
+  INTERN_SLOTS = 1 << 22,
+  INTERN_MAX_LOAD = INTERN_SLOTS / 4 * 3,
+  INTERN_ARENA_SIZE = 1 << 26
+};
+
+static _Atomic uint64_t intern_slots[INTERN_SLOTS];
+static atomic_size_t intern_count;
+static char intern_arena[INTERN_ARENA_SIZE];
+static atomic_size_t intern_arena_len = 1;
+
+static
+inline
+uint32_t
+intern_hash(const char *str, size_t *len) {
+  uint32_t hash = 2166136261u;
+  const char *ptr = str;
+
+  while (*ptr) {
+    hash ^= (unsigned char)*ptr++;
+    hash *= 16777619u;
+  }
+
+  *len = ptr - str;
+
+  return hash;
+}
+
+static
+uint32_t
+intern_probe(const char *str, bool insert) {
+  if (!str) {
+    return 0;
+  }
+
+  size_t len = 0;
+  uint32_t hash = intern_hash(str, &len);
+  uint32_t id = 0;
+
+  for (size_t n = 0, i = hash & (INTERN_SLOTS - 1); n < INTERN_SLOTS;
+       ++n, i = (i + 1) & (INTERN_SLOTS - 1)) {
+    uint64_t slot = atomic_load_explicit(&intern_slots[i],
+        memory_order_acquire);
+
+    if (!slot) {
+      if (!insert) {
+        return 0;
+      }
+
+      /* Reserve and fill the string once, publish it with the slot */
+      if (!id) {
+        if (atomic_fetch_add_explicit(&intern_count, 1,
+              memory_order_relaxed) >= INTERN_MAX_LOAD) {
+          atomic_fetch_sub_explicit(&intern_count, 1, memory_order_relaxed);
+          return 0;
+        }
+
+        size_t offset = atomic_fetch_add_explicit(&intern_arena_len, len + 1,
+            memory_order_relaxed);
+        if (offset + len + 1 > INTERN_ARENA_SIZE) {
+          return 0;
+        }
+
+        memcpy(intern_arena + offset, str, len + 1);
+        id = (uint32_t)offset;
+      }
+
+      uint64_t desired = (uint64_t)hash << 32 | id;
+      if (atomic_compare_exchange_strong_explicit(&intern_slots[i], &slot,
+            desired, memory_order_release, memory_order_acquire)) {
+        return id;
+      }
+
+      /* Lost the race, slot now holds the winner */
+    }
+
+    if ((uint32_t)(slot >> 32) == hash &&
+        !strcmp(intern_arena + (uint32_t)slot, str)) {
+      if (id) {
+        atomic_fetch_sub_explicit(&intern_count, 1, memory_order_relaxed);
+      }
+      return (uint32_t)slot;
+    }
+  }
+
+  return 0;
+}
+
+/* Returns the id of str, interning it first if needed, exits when full */
+static
+uint32_t
+intern(const char *str) {
+  uint32_t id = intern_probe(str, true);
+
+  if (!id && str) {
+    err("interner full: slots: %d arena: %d\n", INTERN_SLOTS,
+        INTERN_ARENA_SIZE);
+    fprintf(stderr, "Too many distinct names to lint\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return id;
+}
+
+/* Returns the id of str, 0 if it has never been interned */
+static
+inline
+uint32_t
+intern_lookup(const char *str) {
+  return intern_probe(str, false);
+}
+
+static
+inline
+const char*
+interned_string(uint32_t id) {
+  return id ? intern_arena + id : NULL;
+}
+
 /* Hash map */
 
 static
@@ -670,17 +1115,12 @@ insert_line(struct lines_map *map, const char *current_line,
   }
 }
 
+/* Ids are arena offsets which grow with the names, mix them before bucketing */
 static
+inline
 unsigned int
-fnv1a(const char *key) {
-  unsigned int hash = 2166136261u;
-
-  while (*key) {
-    hash ^= (unsigned char)*key++;
-    hash *= 16777619u;
-  }
-
-  return hash % HASH_SIZE;
+symbol_bucket(uint32_t id) {
+  return (unsigned int)((id * 2654435761u) >> 16) % HASH_SIZE;
 }
 
 static
@@ -726,21 +1166,21 @@ destroy_tree(struct trie_node *root) {
   free(root);
 }
 
+/* Symbols are keyed by interned id, intern names once when extracting them */
 static
 void
-insert_symbol(struct hash_map *map, const char *name, size_t linenum,
+insert_symbol(struct hash_map *map, uint32_t id, size_t linenum,
     enum symbol_type type) {
 
-  if (!map || !name || !*name) {
+  if (!map || !id || !*interned_string(id)) {
     return;
   }
 
-  unsigned int index = fnv1a(name);
+  unsigned int index = symbol_bucket(id);
 
 #ifdef __HASHMAP_CHK_DUPLICATES
   for (struct symbol *p = map->table[index]; p; p = p->next) {
-    /* TODO: add name_len as parameter */
-    if (!strncmp(name, p->name, strlen(name)) &&
+    if (p->id == id &&
         type == p->type &&
         linenum == p->linenum) {
       return;
@@ -753,8 +1193,9 @@ insert_symbol(struct hash_map *map, const char *name, size_t linenum,
     return;
   }
 
-  strncpy(entry->name, name, sizeof(entry->name) - 1);
   entry->type = type;
+  entry->versions = 0;
+  entry->id = id;
   entry->linenum = linenum;
   entry->next = map->table[index];
 
@@ -763,11 +1204,15 @@ insert_symbol(struct hash_map *map, const char *name, size_t linenum,
 
 static
 struct symbol*
-find_symbol(struct hash_map *map, const char *name, enum symbol_type type) {
-  unsigned int index = fnv1a(name);
+find_symbol(struct hash_map *map, uint32_t id, enum symbol_type type) {
+  if (!map || !id) {
+    return NULL;
+  }
 
-  for (struct symbol *entry = map->table[index]; entry; entry = entry->next) {
-    if (strcmp(entry->name, name) || (type != NONE && type != entry->type)) {
+  for (struct symbol *entry = map->table[symbol_bucket(id)]; entry;
+       entry = entry->next) {
+    if (entry->id != id ||
+        (type != NONE && type != entry->type)) {
       continue;
     }
     return entry;
@@ -823,12 +1268,12 @@ store_map(struct hash_map *map, const char *mapname, size_t mapname_len,
         int ret = 0;
 
         if (fp) {
-          ret = fprintf(fp, "%lu,%s,%d,%lu\n", i, entry->name,
+          ret = fprintf(fp, "%lu,%s,%d,%lu\n", i, interned_string(entry->id),
               entry->type, entry->linenum);
 
         } else if (buffer) {
-          ret = snprintf(buffer + n, len - n, "%lu,%s,%d,%lu\n", i, entry->name,
-              entry->type, entry->linenum);
+          ret = snprintf(buffer + n, len - n, "%lu,%s,%d,%lu\n", i,
+              interned_string(entry->id), entry->type, entry->linenum);
         }
 
         if (ret < 0) {
@@ -844,12 +1289,14 @@ store_map(struct hash_map *map, const char *mapname, size_t mapname_len,
 
 #if DBG_ENABLED
         if (buffer) {
-          dbg("%lu,%s,%d,%lu: n %lu buffer: %.*s\n", i, entry->name,
+          dbg("%lu,%s,%d,%lu: n %lu buffer: %.*s\n", i,
+              interned_string(entry->id),
               entry->type, entry->linenum, n, (int)(n - prev_n),
               buffer + prev_n);
         } else {
           dbg("map: %s entry: %p %lu,%s,%d,%lu: n %lu\n", mapname,
-              (void*)entry, i, entry->name, entry->type, entry->linenum, n);
+              (void*)entry, i, interned_string(entry->id), entry->type,
+              entry->linenum, n);
         }
 #endif
       }
@@ -902,6 +1349,7 @@ load_map(struct hash_map *map, const char *mapname, size_t mapname_len,
 
   while (len || fp) {
     size_t index;
+    char name[MAX_LEN];
     struct symbol *entry = (struct symbol*)malloc(sizeof(struct symbol));
     if (!entry) {
       break;
@@ -909,11 +1357,11 @@ load_map(struct hash_map *map, const char *mapname, size_t mapname_len,
 
     do {
       if (fp) {
-        ret = fscanf(fp, "%lu,%[^,],%d,%lu\n%n", &index, &entry->name[0],
+        ret = fscanf(fp, "%lu,%1023[^,],%d,%lu\n%n", &index, name,
             (int*)&entry->type, &entry->linenum, &nread);
 
       } else if (buffer) {
-        ret = sscanf(buffer + n, "%lu,%[^,],%d,%lu\n%n", &index, &entry->name[0],
+        ret = sscanf(buffer + n, "%lu,%1023[^,],%d,%lu\n%n", &index, name,
             (int*)&entry->type, &entry->linenum, &nread);
       }
 
@@ -941,9 +1389,13 @@ load_map(struct hash_map *map, const char *mapname, size_t mapname_len,
     len -= nread;   // integer arithmetic works just fine!
     n += nread;
 
-    dbg("%lu,%s,%d,%lu\n", index, entry->name, entry->type, entry->linenum);
+    dbg("%lu,%s,%d,%lu\n", index, name, entry->type, entry->linenum);
 
-    /* Insert into hash table */
+    entry->versions = 0;
+    entry->id = intern(name);
+
+    /* Ids differ between runs, the stored bucket is only informative */
+    index = symbol_bucket(entry->id);
     entry->next = map->table[index];
     map->table[index] = entry;
   }
@@ -961,6 +1413,10 @@ void destroy_progdata(struct progdata *pdata) {
   destroy_map(&pdata->defs);
   destroy_map(&pdata->refs);
   destroy_tree(pdata->cmds);
+
+  destroy_tree(pdata->vindex.cmds);
+  destroy_map(&pdata->vindex.settings);
+  destroy_map(&pdata->vindex.vars);
 }
 
 static
@@ -1019,7 +1475,7 @@ parse_gdb_output(char *ptr_arg, size_t len, const char *delim, size_t delimlen)
 static
 bool
 load_gdb_arch(size_t n, char archlist[n][ARCH_LEN]) {
-  FILE *fp = popen("gdb -batch -ex 'set architecture' 2>&1", "r");
+  FILE *fp = spawn_gdb("gdb -batch -ex 'set architecture' 2>&1");
   if (!fp) {
     err("popen failed: %s\n", strerror(errno));
     return false;
@@ -1096,7 +1552,7 @@ load_gdb_registers(struct progdata *pdata, const char *arch) {
     arch
   );
 
-  FILE *fp = popen(cmd, "r");
+  FILE *fp = spawn_gdb(cmd);
   if (!fp) {
     err("popen failed: %s\n", strerror(errno));
     return false;
@@ -1120,14 +1576,14 @@ load_gdb_registers(struct progdata *pdata, const char *arch) {
       ++ptr;
     }
 
-    if (isupper(*ptr)) {
+    if (isupper((unsigned char)*ptr)) {
       continue;
     }
 
     ptr = strntok(ptr, strlen(ptr), ", \t\n", strlen(", \t\n"));
     if (ptr && ptr[0] != '\'' && ptr[1] != '\'') {
       dbg("register: %s\n", ptr);
-      insert_symbol(&pdata->defs, ptr, 0, VAR);
+      insert_symbol(&pdata->defs, intern(ptr), 0, VAR);
     }
   }
   if (nread < 0 && localerrno != 0) {
@@ -1149,7 +1605,7 @@ load_gdb_commands(struct progdata *pdata) {
     return false;
   }
 
-  FILE *fp = popen("gdb -batch -ex 'help all' 2>/dev/null", "r");
+  FILE *fp = spawn_gdb("gdb -batch -ex 'help all' 2>/dev/null");
   if (!fp) {
     err("popen failed: %s\n", strerror(errno));
     return false;
@@ -1168,8 +1624,8 @@ load_gdb_commands(struct progdata *pdata) {
 #else
   while (fgets_e(buffer, buflen, fp, &localerrno)) {
 #endif
-    if (isalpha(buffer[0]) &&
-        islower(buffer[0])) {
+    if (isalpha((unsigned char)buffer[0]) &&
+        islower((unsigned char)buffer[0])) {
 
       char *ptr = buffer;
 
@@ -1236,7 +1692,7 @@ load_gdb_convenience_vars(struct progdata *pdata) {
     return false;
   }
 
-  FILE *fp = popen("gdb -batch -ex 'show convenience' 2>/dev/null", "r");
+  FILE *fp = spawn_gdb("gdb -batch -ex 'show convenience' 2>/dev/null");
   if (!fp) {
     err("popen failed: %s\n", strerror(errno));
     return false;
@@ -1263,7 +1719,7 @@ load_gdb_convenience_vars(struct progdata *pdata) {
       const char *ptr =
         strntok(buffer + 1, strlen(buffer + 1), ", \t\n", strlen(", \t\n"));
       if (ptr) {
-        insert_symbol(&pdata->defs, ptr, 0, VAR);
+        insert_symbol(&pdata->defs, intern(ptr), 0, VAR);
       }
     }
   }
@@ -1277,27 +1733,27 @@ load_gdb_convenience_vars(struct progdata *pdata) {
   pclose(fp);
 
   /* Other convenience variables */
-  insert_symbol(&pdata->defs, "_", 0, VAR);
-  insert_symbol(&pdata->defs, "__", 0, VAR);
-
-  insert_symbol(&pdata->defs, "_exitcode", 0, VAR);
-  insert_symbol(&pdata->defs, "_exitsignal", 0, VAR);
-  insert_symbol(&pdata->defs, "_exception", 0, VAR);
-  insert_symbol(&pdata->defs, "_ada_exception", 0, VAR);
-  insert_symbol(&pdata->defs, "_probe_argc", 0, VAR);
-  insert_symbol(&pdata->defs, "_probe_arg0…$_probe_arg11", 0, VAR);
-  insert_symbol(&pdata->defs, "_sdata", 0, VAR);
-  insert_symbol(&pdata->defs, "_siginfo", 0, VAR);
-  insert_symbol(&pdata->defs, "_thread", 0, VAR);
-  insert_symbol(&pdata->defs, "_gthread", 0, VAR);
-  insert_symbol(&pdata->defs, "_inferior_thread_count", 0, VAR);
-  insert_symbol(&pdata->defs, "_gdb_major", 0, VAR);
-  insert_symbol(&pdata->defs, "_gdb_minor", 0, VAR);
-  insert_symbol(&pdata->defs, "_shell_exitcode", 0, VAR);
-  insert_symbol(&pdata->defs, "_shell_exitsignal", 0, VAR);
-
-  insert_symbol(&pdata->defs, "bpnum", 0, VAR);
-  insert_symbol(&pdata->defs, "cdir", 0, VAR);
+  insert_symbol(&pdata->defs, intern("_"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("__"), 0, VAR);
+
+  insert_symbol(&pdata->defs, intern("_exitcode"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_exitsignal"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_exception"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_ada_exception"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_probe_argc"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_probe_arg0…$_probe_arg11"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_sdata"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_siginfo"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_thread"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_gthread"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_inferior_thread_count"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_gdb_major"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_gdb_minor"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_shell_exitcode"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("_shell_exitsignal"), 0, VAR);
+
+  insert_symbol(&pdata->defs, intern("bpnum"), 0, VAR);
+  insert_symbol(&pdata->defs, intern("cdir"), 0, VAR);
 
   return ret;
 }
@@ -1323,7 +1779,7 @@ is_history_var(const char *word) {
   }
 
   do {
-    if (!isdigit(*word++)) {
+    if (!isdigit((unsigned char)*word++)) {
       return false;
     }
   } while (word && *word);
@@ -1353,7 +1809,7 @@ is_func_arg(const char *word) {
   }
 
   do {
-    if (!isdigit(*word++)) {
+    if (!isdigit((unsigned char)*word++)) {
       return false;
     }
   } while (word && *word);
@@ -1399,7 +1855,7 @@ is_number(const char *token) {
   }
 
   while (token && *token) {
-    if (!isdigit(*token++)) {
+    if (!isdigit((unsigned char)*token++)) {
       return false;
     }
   }
@@ -1421,7 +1877,7 @@ is_floating_point(const char *token) {
   bool dec = false;
 
   for (; token && *token; ++token) {
-    if (!isdigit(*token) && (dec || !(dec = (*token == '.')))) {
+    if (!isdigit((unsigned char)*token) && (dec || !(dec = (*token == '.')))) {
       return false;
     }
   }
@@ -1440,6 +1896,17 @@ is_valid_reference(struct progdata *pdata, const char *token) {
          !is_floating_point(token);
 }
 
+static
+int
+linenum_width(size_t max_linenum) {
+  int width = 1;
+  while (max_linenum) {
+    max_linenum /= 10;
+    ++width;
+  }
+  return width;
+}
+
 static
 void
 calc_linenum_width(struct progdata *pdata) {
@@ -1447,13 +1914,7 @@ calc_linenum_width(struct progdata *pdata) {
     return;
   }
 
-  size_t max_linenum = pdata->linemap.max_linenum;
-
-  pdata->linenum_width = 1;
-  while (max_linenum) {
-    max_linenum /= 10;
-    ++pdata->linenum_width;
-  }
+  pdata->linenum_width = linenum_width(pdata->linemap.max_linenum);
 }
 
 static
@@ -1481,6 +1942,8 @@ parse_gdbfile(struct progdata *pdata, FILE *fp) {
     size_t len = strlen(buffer);
 #endif
 
+    metrics()->bytes += len;
+
     if (len > 0 && buffer[len - 1] == '\n') {
       buffer[len - 1] = '\0';
     }
@@ -1503,6 +1966,8 @@ parse_gdbfile(struct progdata *pdata, FILE *fp) {
 
   buffer && (free(buffer), 1);
 
+  metrics()->lines += orig_linenum - 1;
+
   calc_linenum_width(pdata);
 }
 
@@ -1544,7 +2009,7 @@ extract_defs(struct progdata *pdata) {
 
     if (type != NONE) {
       size_t length = matches[1].rm_eo - matches[1].rm_so;
-      char name[MAX_LEN - 1];
+      char name[MAX_LEN];
 
       dbg("definition : [%.*s]\n", (int)length,
           pdata->linemap.lines[i].line + matches[1].rm_so);
@@ -1552,7 +2017,7 @@ extract_defs(struct progdata *pdata) {
       strncpy(name, pdata->linemap.lines[i].line + matches[1].rm_so, length);
       name[length] = '\0';
 
-      insert_symbol(&pdata->defs, name,
+      insert_symbol(&pdata->defs, intern(name),
           pdata->linemap.lines[i].orig_linenum, type);;
     }
   }
@@ -1613,12 +2078,12 @@ extract_refs(struct progdata *pdata) {
 
       dbg("func reference: [%.*s]\n", (int)length, cursor + matches[2].rm_so);
 
-      char name[MAX_LEN - 1];
+      char name[MAX_LEN];
       strncpy(name, cursor + matches[2].rm_so, length);
       name[length] = '\0';
 
       if (is_valid_reference(pdata, name)) {
-        insert_symbol(&pdata->refs, name,
+        insert_symbol(&pdata->refs, intern(name),
             pdata->linemap.lines[i].orig_linenum, FUNC);
       }
 
@@ -1632,7 +2097,7 @@ extract_refs(struct progdata *pdata) {
     while (*cursor && regexec(&var_regex, cursor, 3, matches, 0) == 0) {
 
       size_t length = matches[2].rm_eo - matches[2].rm_so;
-      char name[MAX_LEN - 1];
+      char name[MAX_LEN];
 
       dbg("var reference: [%.*s]\n", (int)length, cursor + matches[2].rm_so);
 
@@ -1640,7 +2105,7 @@ extract_refs(struct progdata *pdata) {
       name[length] = '\0';
 
       if (is_valid_reference(pdata, name)) {
-        insert_symbol(&pdata->refs, name,
+        insert_symbol(&pdata->refs, intern(name),
             pdata->linemap.lines[i].orig_linenum, VAR);
       }
 
@@ -1652,297 +2117,2285 @@ extract_refs(struct progdata *pdata) {
   regfree(&func_regex);
 }
 
+/* Fast engine */
+
+/*
+ * Hand written scanners equivalent to the POSIX leftmost-longest matches of
+ * the regular expressions in extract_defs and extract_refs. Every line is
+ * scanned once from left to right without backtracking. Use --engine=diff to
+ * check the equivalence on any input.
+ */
+
+static
+inline
+bool
+is_space_char(int c) {
+  /* [[:space:]] in the C locale, which is what \s means to glibc */
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+         c == '\r';
+}
+
 static
-int
-report_unused(struct progdata *pdata, struct args *pargs) {
-  if (!pdata || !pargs || pargs->no_warn_unused) {
-    return 0;
+inline
+bool
+is_name_char(int c) {
+  /* [a-zA-Z0-9_-] */
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+static
+inline
+const char*
+skip_spaces(const char *str) {
+  while (is_space_char(*str)) {
+    ++str;
   }
+  return str;
+}
 
-  int count = 0;
+static
+inline
+size_t
+name_span(const char *str, bool dollar) {
+  size_t n = 0;
+  while (is_name_char(str[n]) || (dollar && str[n] == '$')) {
+    ++n;
+  }
+  return n;
+}
 
-  for (size_t i = 0; i < HASH_SIZE; i++) {
-    for (struct symbol *def = pdata->defs.table[i]; def != NULL &&
-         def->linenum != 0; def = def->next) {
-      if (pargs->no_warn_unused_func && def->type == FUNC) {
-        continue;
-      }
+/* Matches "^\s*<keyword>\s+" and returns the position after it */
+static
+const char*
+match_keyword(const char *line, const char *keyword, size_t keyword_len) {
+  const char *ptr = skip_spaces(line);
 
-      if (pargs->no_warn_unused_var && def->type == VAR) {
-        continue;
-      }
+  if (strncmp(ptr, keyword, keyword_len) || !is_space_char(ptr[keyword_len])) {
+    return NULL;
+  }
 
-      if (!find_symbol(&pdata->refs, def->name, def->type)) {
-        if (pargs->action == SCRIPTABLE) {
-          printf("  \"");
-        }
+  return skip_spaces(ptr + keyword_len);
+}
 
-        printf(
-          "%s:%.*ld: "
-          "Unused %s: '%s' defined at line %ld is never used",
-          pargs->gdbfile ? basename(pargs->gdbfile) : "STDIN",
-          pdata->linenum_width, def->linenum,
-          def->type == FUNC ? "func" : def->type == VAR ? "var" : NULL,
-          def->name, def->linenum
-        );
+/* Matches "set_convenience_variable\(\"?([a-zA-Z0-9_-]+)\"?," */
+static
+size_t
+match_py_setvar(const char *str, const char **name) {
+  static const char fn[] = "set_convenience_variable(";
 
-        if (pargs->action == SCRIPTABLE) {
-          printf("\\n\"\\\n");
-        } else {
-          putchar('\n');
-        }
+  size_t length = 0;
 
-        ++count;
-      }
+  /* The greedy ".*" prefers the last occurrence which matches */
+  for (
+      const char *ptr = strstr(str, fn);
+      ptr;
+      ptr = strstr(ptr + 1, fn)
+    ) {
+    const char *start = ptr + sizeof(fn) - 1;
+    if (*start == '"') {
+      ++start;
+    }
+
+    size_t n = name_span(start, false);
+    const char *end = start + n;
+    if (*end == '"') {
+      ++end;
+    }
+
+    if (n && *end == ',') {
+      *name = start;
+      length = n;
     }
   }
 
-  return count;
+  return length;
 }
 
 static
-int
-report_undefined(struct progdata *pdata, struct args *pargs) {
-  if (!pdata || !pargs || pargs->no_warn_undef) {
-    return 0;
+void
+extract_defs_fast(struct progdata *pdata) {
+  if (!pdata) {
+    return;
   }
 
-  int count = 0;
+  for (size_t i = 0; i < pdata->linemap.count; i++) {
+    char *line = pdata->linemap.lines[i].line;
 
-  for (size_t i = 0; i < HASH_SIZE; i++) {
-    for (struct symbol *ref = pdata->refs.table[i]; ref != NULL;
-         ref = ref->next) {
-      if (pargs->no_warn_undef_func && ref->type == FUNC) {
+    char *ptr = index(line, '#');
+    if (ptr) {
+      *ptr = '\0';
+    }
+
+    const char *name = NULL;
+    size_t length = 0;
+    enum symbol_type type = NONE;
+
+    if ((name = match_keyword(line, "define", sizeof("define") - 1)) &&
+        (length = name_span(name, false))) {
+      type = FUNC;
+
+    } else if (
+      (name = match_keyword(line, "set", sizeof("set") - 1)) &&
+      *name++ == '$' &&
+      (length = name_span(name, false))
+    ) {
+      type = VAR;
+
+    } else if (
+      !strncmp((name = skip_spaces(line)), "python", sizeof("python") - 1) &&
+      (length = match_py_setvar(name + sizeof("python") - 1, &name))
+    ) {
+      type = VAR;
+    }
+
+    if (type != NONE) {
+      char symname[MAX_LEN];
+
+      dbg("definition : [%.*s]\n", (int)length, name);
+
+      strncpy(symname, name, length);
+      symname[length] = '\0';
+
+      insert_symbol(&pdata->defs, intern(symname),
+          pdata->linemap.lines[i].orig_linenum, type);
+    }
+  }
+}
+
+/*
+ * Matches "(^\s*|;\s*)([a-zA-Z0-9_-]+)(\s+[$a-zA-Z0-9_-]+)*\s*(;|$)" at str,
+ * returns the end of the match or NULL.
+ */
+static
+const char*
+match_func_stmt(const char *str, bool bol, const char **name, size_t *length) {
+  if (*str == ';') {
+    ++str;
+  } else if (!bol) {
+    return NULL;
+  }
+
+  str = skip_spaces(str);
+
+  size_t n = name_span(str, false);
+  if (!n) {
+    return NULL;
+  }
+
+  *name = str;
+  *length = n;
+
+  for (str += n;;) {
+    const char *ptr = skip_spaces(str);
+
+    if (*ptr == ';') {
+      return ptr + 1;
+    }
+    if (*ptr == '\0') {
+      return ptr;
+    }
+    if (ptr == str || !(n = name_span(ptr, true))) {
+      return NULL;
+    }
+
+    str = ptr + n;
+  }
+}
+
+static
+void
+extract_refs_fast(struct progdata *pdata) {
+  if (!pdata) {
+    return;
+  }
+
+  for (size_t i = 0; i < pdata->linemap.count; i++) {
+    char *ptr = index(pdata->linemap.lines[i].line, '#');
+    if (ptr) {
+      *ptr = '\0';
+    }
+
+    if (strstr(pdata->linemap.lines[i].line, "define ")) {
+      continue;
+    }
+
+    ptr = strstr(pdata->linemap.lines[i].line, "set ");
+    if (ptr) {
+      ptr = strstr(ptr, "=");
+      if (!ptr) {
         continue;
       }
+    } else {
+      ptr = pdata->linemap.lines[i].line;
+    }
 
-      if (pargs->no_warn_undef_var && ref->type == VAR) {
+    const char *cursor = ptr;
+    const char *name = NULL;
+    size_t length = 0;
+    char symname[MAX_LEN];
+
+    dbg("cursor: %s\n", cursor);
+
+    while (*cursor) {
+      const char *end = match_func_stmt(cursor, true, &name, &length);
+
+      for (
+          const char *semi = index(cursor + 1, ';');
+          !end && semi;
+          semi = index(semi + 1, ';')
+        ) {
+        end = match_func_stmt(semi, false, &name, &length);
+      }
+
+      if (!end) {
+        break;
+      }
+
+      dbg("func reference: [%.*s]\n", (int)length, name);
+
+      strncpy(symname, name, length);
+      symname[length] = '\0';
+
+      if (is_valid_reference(pdata, symname)) {
+        insert_symbol(&pdata->refs, intern(symname),
+            pdata->linemap.lines[i].orig_linenum, FUNC);
+      }
+
+      cursor = end;
+    }
+
+    cursor = ptr;
+
+    dbg("cursor: %s\n", cursor);
+
+    while (*cursor) {
+      for (; *cursor && !(*cursor == '$' && is_name_char(cursor[1])); ++cursor);
+      if (!*cursor) {
+        break;
+      }
+
+      name = cursor + 1;
+      length = name_span(name, false);
+
+      dbg("var reference: [%.*s]\n", (int)length, name);
+
+      strncpy(symname, name, length);
+      symname[length] = '\0';
+
+      if (is_valid_reference(pdata, symname)) {
+        insert_symbol(&pdata->refs, intern(symname),
+            pdata->linemap.lines[i].orig_linenum, VAR);
+      }
+
+      cursor = skip_spaces(name + length);
+    }
+  }
+}
+
+/* GDB version snapshots */
+
+/*
+ * A snapshot holds the commands, settings and convenience variables of one
+ * gdb version:
+ *
+ *   gdb 12
+ *   cmd print
+ *   set print pretty
+ *   var _exitcode
+ *
+ * Snapshots of several versions are merged into a version index in which
+ * every name carries the bitset of the versions providing it.
+ */
+
+static
+void
+insert_versioned_command(struct trie_node **root, const char *command,
+    unsigned int versions) {
+
+  if (!root || !command) {
+    return;
+  }
+
+  if (!*root && !(*root = create_node())) {
+    return;
+  }
+
+  struct trie_node *node = *root;
+
+  /* Every prefix is a valid abbreviation in the versions below it */
+  for (; *command; ++command) {
+    int c = (unsigned char)*command - '!';
+    if (c < 0 || c >= MAX_CHILDREN) {
+      return;
+    }
+
+    if (!node->children[c] && !(node->children[c] = create_node())) {
+      return;
+    }
+    node = node->children[c];
+    node->versions |= versions;
+  }
+
+  node->end = true;
+}
+
+static
+unsigned int
+find_command_versions(struct trie_node *root, const char *command,
+    size_t len) {
+
+  struct trie_node *node = root;
+
+  for (size_t i = 0; node && i < len; ++i) {
+    int c = (unsigned char)command[i] - '!';
+    if (c < 0 || c >= MAX_CHILDREN) {
+      return 0;
+    }
+    node = node->children[c];
+  }
+
+  return node && node != root ? node->versions : 0;
+}
+
+static
+void
+insert_versioned_symbol(struct hash_map *map, const char *name,
+    unsigned int versions) {
+
+  uint32_t id = intern(name);
+
+  struct symbol *entry = find_symbol(map, id, NONE);
+  if (!entry) {
+    insert_symbol(map, id, 0, VAR);
+    entry = find_symbol(map, id, NONE);
+  }
+
+  if (entry) {
+    entry->versions |= versions;
+  }
+}
+
+static
+unsigned int
+find_symbol_versions(struct hash_map *map, const char *name) {
+  /* A name never interned is in no snapshot */
+  struct symbol *entry = find_symbol(map, intern_lookup(name), NONE);
+  return entry ? entry->versions : 0;
+}
+
+static
+bool
+load_snapshot(struct version_index *vindex, const char *path) {
+  if (!vindex || !path) {
+    return false;
+  }
+
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    err("fopen failed for path: %s error: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  char line[MAX_LEN];
+  int version = 0;
+
+  if (!fgets(line, sizeof(line), fp) ||
+      sscanf(line, "gdb %d", &version) != 1) {
+    fprintf(stderr, "Invalid snapshot: %s\n", path);
+    fclose(fp);
+    return false;
+  }
+
+  size_t bit = 0;
+  while (bit < vindex->count && vindex->versions[bit] != version) {
+    ++bit;
+  }
+
+  if (bit == MAX_VERSIONS) {
+    fprintf(stderr, "Too many gdb versions, ignoring snapshot: %s\n", path);
+    fclose(fp);
+    return false;
+  }
+
+  if (bit == vindex->count) {
+    vindex->versions[vindex->count++] = version;
+  }
+
+  unsigned int mask = 1u << bit;
+
+  while (fgets(line, sizeof(line), fp)) {
+    size_t len = strlen(line);
+    if (len && line[len - 1] == '\n') {
+      line[len - 1] = '\0';
+    }
+
+    if (!strncmp(line, "cmd ", sizeof("cmd ") - 1)) {
+      insert_versioned_command(&vindex->cmds, line + sizeof("cmd ") - 1, mask);
+    } else if (!strncmp(line, "set ", sizeof("set ") - 1)) {
+      insert_versioned_symbol(&vindex->settings, line + sizeof("set ") - 1,
+          mask);
+    } else if (!strncmp(line, "var ", sizeof("var ") - 1)) {
+      insert_versioned_symbol(&vindex->vars, line + sizeof("var ") - 1, mask);
+    }
+  }
+
+  fclose(fp);
+
+  return true;
+}
+
+/* Parses an entry of 'help all', "print, inspect, p -- Print value..." */
+static
+void
+store_snapshot_commands(FILE *fp, char *line) {
+  char *desc = strstr(line, " -- ");
+  if (!desc) {
+    return;
+  }
+  *desc = '\0';
+
+  for (
+      char *alias = strtok(line, ",");
+      alias;
+      alias = strtok(NULL, ",")
+    ) {
+    alias = (char*)skip_spaces(alias);
+
+    size_t n = name_span(alias, false);
+    if (!n) {
+      continue;
+    }
+
+    fprintf(fp, "cmd %.*s\n", (int)n, alias);
+
+    if ((n == 3 && !strncmp(alias, "set", 3)) ||
+        (n == 4 && !strncmp(alias, "show", 4))) {
+      const char *setting = skip_spaces(alias + n);
+      if (*setting) {
+        fprintf(fp, "set %s\n", setting);
+      }
+    }
+  }
+}
+
+/* Store a snapshot of the installed gdb */
+static
+bool
+save_snapshot(const char *path) {
+  if (!path) {
+    return false;
+  }
+
+  FILE *gdbfp = spawn_gdb(
+    "gdb -batch -ex 'print $_gdb_major' -ex 'show convenience' "
+    "-ex 'help all' 2>/dev/null"
+  );
+  if (!gdbfp) {
+    err("popen failed: %s\n", strerror(errno));
+    return false;
+  }
+
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    err("fopen failed for path: %s error: %s\n", path, strerror(errno));
+    pclose(gdbfp);
+    return false;
+  }
+
+  char line[MAX_LEN];
+  int version = 0;
+
+  while (fgets(line, sizeof(line), gdbfp)) {
+    size_t len = strlen(line);
+    if (len && line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+
+    if (!version) {
+      if (sscanf(line, "$1 = %d", &version) == 1) {
+        fprintf(fp, "gdb %d\n", version);
+      }
+      continue;
+    }
+
+    if (line[0] == '$') {
+      if (strstr(line, "internal function")) {
         continue;
       }
 
-      if (!find_symbol(&pdata->defs, ref->name, ref->type)) {
-        if (pargs->action == SCRIPTABLE) {
-          printf("  \"");
-        }
+      size_t n = name_span(line + 1, false);
+      if (n) {
+        fprintf(fp, "var %.*s\n", (int)n, line + 1);
+      }
 
-        printf(
-          "%s:%.*ld: "
-          "Undefined %s: '%s' is referenced at line %ld but never defined",
-          pargs->gdbfile ? basename(pargs->gdbfile) : "STDIN",
-          pdata->linenum_width, ref->linenum,
-          ref->type == FUNC ? "func" : ref->type == VAR ? "var" : NULL,
-          ref->name, ref->linenum
-        );
+    } else if (islower((unsigned char)line[0])) {
+      store_snapshot_commands(fp, line);
+    }
+  }
+
+  pclose(gdbfp);
+
+  if (fclose(fp) || !version) {
+    fprintf(stderr, "Could not snapshot gdb to: %s\n", path);
+    remove(path);
+    return false;
+  }
+
+  return true;
+}
+
+static
+bool
+select_versions(struct version_index *vindex, const char *list) {
+  if (!vindex) {
+    return false;
+  }
+
+  if (!list) {
+    vindex->selected = vindex->count == MAX_VERSIONS ?
+      ~0u : (1u << vindex->count) - 1;
+    return true;
+  }
+
+  vindex->selected = 0;
+
+  for (const char *ptr = list; *ptr;) {
+    char *end = NULL;
+    long version = strtol(ptr, &end, 10);
+    if (end == ptr) {
+      fprintf(stderr, "Invalid gdb versions: %s\n", list);
+      return false;
+    }
+
+    size_t bit = 0;
+    while (bit < vindex->count && vindex->versions[bit] != version) {
+      ++bit;
+    }
+
+    if (bit == vindex->count) {
+      fprintf(stderr, "No snapshot for gdb %ld\n", version);
+      return false;
+    }
+
+    vindex->selected |= 1u << bit;
+
+    ptr = *end == ',' ? end + 1 : end;
+  }
+
+  return true;
+}
+
+/*
+ * One bit per interned id and symbol type. A report marks every symbol of one
+ * map and answers lookups into it by id, so the cost does not depend on how
+ * many names share a bucket. Cleared after every use, reports run on the
+ * main thread only.
+ */
+static unsigned char symbol_marks[2][INTERN_ARENA_SIZE / CHAR_BIT];
+
+static
+void
+mark_symbols(struct hash_map *map, bool mark) {
+  for (size_t i = 0; i < HASH_SIZE; i++) {
+    for (struct symbol *sym = map->table[i]; sym; sym = sym->next) {
+      if (sym->type == NONE) {
+        continue;
+      }
+
+      unsigned char *byte = &symbol_marks[sym->type][sym->id / CHAR_BIT];
+      unsigned char bit = 1u << (sym->id % CHAR_BIT);
+
+      *byte = mark ? *byte | bit : *byte & ~bit;
+    }
+  }
+}
+
+static
+inline
+bool
+is_marked(uint32_t id, enum symbol_type type) {
+  return symbol_marks[type][id / CHAR_BIT] & (1u << (id % CHAR_BIT));
+}
+
+static
+void
+append_symbol(struct symbol ***syms, size_t *n, struct symbol *sym) {
+  /* Grow at powers of two */
+  if (!(*n & (*n - 1))) {
+    struct symbol **tmp = (struct symbol**)realloc(*syms,
+        (*n ? *n << 1 : 1) * sizeof(struct symbol*));
+    if (!tmp) {
+      err("realloc failed: error: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    *syms = tmp;
+  }
+
+  (*syms)[(*n)++] = sym;
+}
+
+static
+int
+compare_symbols(const void *a, const void *b) {
+  const struct symbol *lhs = *(const struct symbol *const*)a;
+  const struct symbol *rhs = *(const struct symbol *const*)b;
+
+  if (lhs->linenum != rhs->linenum) {
+    return lhs->linenum < rhs->linenum ? -1 : 1;
+  }
+
+  int cmp = strcmp(interned_string(lhs->id), interned_string(rhs->id));
+  if (cmp) {
+    return cmp;
+  }
+
+  return (int)lhs->type - (int)rhs->type;
+}
+
+/*
+ * Diagnostics follow the script line by line, interned ids depend on what
+ * gdb introspection interned first and cannot order them.
+ */
+static
+void
+sort_symbols(struct symbol **syms, size_t n) {
+  if (n > 1) {
+    qsort(syms, n, sizeof(struct symbol*), compare_symbols);
+  }
+}
+
+static
+int
+report_unused(struct progdata *pdata, struct args *pargs, FILE *out) {
+  if (!pdata || !pargs || !out || pargs->no_warn_unused) {
+    return 0;
+  }
+
+  struct symbol **unused = NULL;
+  size_t count = 0;
+
+  mark_symbols(&pdata->refs, true);
+
+  for (size_t i = 0; i < HASH_SIZE; i++) {
+    for (struct symbol *def = pdata->defs.table[i]; def != NULL &&
+         def->linenum != 0; def = def->next) {
+      if (pargs->no_warn_unused_func && def->type == FUNC) {
+        continue;
+      }
+
+      if (pargs->no_warn_unused_var && def->type == VAR) {
+        continue;
+      }
+
+      if (!is_marked(def->id, def->type)) {
+        append_symbol(&unused, &count, def);
+      }
+    }
+  }
+
+  mark_symbols(&pdata->refs, false);
+
+  sort_symbols(unused, count);
+
+  for (size_t i = 0; i < count; ++i) {
+    struct symbol *def = unused[i];
+
+    if (pargs->action == SCRIPTABLE) {
+      fputs("  \"", out);
+    }
+
+    fprintf(
+      out,
+      "%s:%.*ld: "
+      "Unused %s: '%s' defined at line %ld is never used",
+      pargs->gdbfile ? basename(pargs->gdbfile) : "STDIN",
+      pdata->linenum_width, def->linenum,
+      def->type == FUNC ? "func" : def->type == VAR ? "var" : NULL,
+      interned_string(def->id), def->linenum
+    );
+
+    ++metrics()->diagnostics[
+      def->type == FUNC ? RULE_UNUSED_FUNC : RULE_UNUSED_VAR
+    ];
+
+    if (pargs->action == SCRIPTABLE) {
+      fputs("\\n\"\\\n", out);
+    } else {
+      fputc('\n', out);
+    }
+  }
+
+  free(unused);
+
+  return (int)count;
+}
+
+static
+int
+report_undefined(struct progdata *pdata, struct args *pargs, FILE *out) {
+  if (!pdata || !pargs || !out || pargs->no_warn_undef) {
+    return 0;
+  }
+
+  struct symbol **undefined = NULL;
+  size_t count = 0;
+
+  mark_symbols(&pdata->defs, true);
+
+  for (size_t i = 0; i < HASH_SIZE; i++) {
+    for (struct symbol *ref = pdata->refs.table[i]; ref != NULL;
+         ref = ref->next) {
+      if (pargs->no_warn_undef_func && ref->type == FUNC) {
+        continue;
+      }
+
+      if (pargs->no_warn_undef_var && ref->type == VAR) {
+        continue;
+      }
+
+      if (!is_marked(ref->id, ref->type)) {
+        append_symbol(&undefined, &count, ref);
+      }
+    }
+  }
+
+  mark_symbols(&pdata->defs, false);
+
+  sort_symbols(undefined, count);
+
+  for (size_t i = 0; i < count; ++i) {
+    struct symbol *ref = undefined[i];
+
+    if (pargs->action == SCRIPTABLE) {
+      fputs("  \"", out);
+    }
+
+    fprintf(
+      out,
+      "%s:%.*ld: "
+      "Undefined %s: '%s' is referenced at line %ld but never defined",
+      pargs->gdbfile ? basename(pargs->gdbfile) : "STDIN",
+      pdata->linenum_width, ref->linenum,
+      ref->type == FUNC ? "func" : ref->type == VAR ? "var" : NULL,
+      interned_string(ref->id), ref->linenum
+    );
+
+    ++metrics()->diagnostics[
+      ref->type == FUNC ? RULE_UNDEF_FUNC : RULE_UNDEF_VAR
+    ];
+
+    if (pargs->action == SCRIPTABLE) {
+      fputs("\\n\"\\\n", out);
+    } else {
+      fputc('\n', out);
+    }
+  }
+
+  free(undefined);
+
+  return (int)count;
+}
+
+static
+void
+print_incompatible(struct progdata *pdata, struct args *pargs, FILE *out,
+    size_t linenum, const char *kind, const char *name, size_t len,
+    unsigned int missing) {
+
+  if (pargs->action == SCRIPTABLE) {
+    fputs("  \"", out);
+  }
+
+  fprintf(
+    out,
+    "%s:%.*ld: "
+    "Incompatible %s: '%.*s' at line %ld is not provided by gdb",
+    pargs->gdbfile ? basename(pargs->gdbfile) : "STDIN",
+    pdata->linenum_width, linenum, kind, (int)len, name, linenum
+  );
+
+  const char *sep = " ";
+  for (size_t bit = 0; bit < pdata->vindex.count; ++bit) {
+    if (missing & (1u << bit)) {
+      fprintf(out, "%s%d", sep, pdata->vindex.versions[bit]);
+      sep = ", ";
+    }
+  }
+
+  if (pargs->action == SCRIPTABLE) {
+    fputs("\\n\"\\\n", out);
+  } else {
+    fputc('\n', out);
+  }
+
+  ++metrics()->diagnostics[RULE_INCOMPAT];
+}
+
+static
+bool
+is_script_def(struct progdata *pdata, const char *name,
+    enum symbol_type type) {
+
+  uint32_t id = intern_lookup(name);
+
+  for (struct symbol *def = id ? pdata->defs.table[symbol_bucket(id)] : NULL;
+       def; def = def->next) {
+    if (def->linenum && def->type == type && def->id == id) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ * Returns true when the line opens a block whose body is python, guile or
+ * documentation rather than gdb commands. Such bodies end at the first "end"
+ * line, so they never nest.
+ */
+static
+bool
+opens_raw_block(const char *line) {
+  static const char *const cmds[] = { "python", "py", "guile", "gu" };
+
+  const char *ptr = skip_spaces(line);
+  size_t n = name_span(ptr, false);
+  const char *rest = skip_spaces(ptr + n);
+
+  if (n == 8 && !strncmp(ptr, "document", 8)) {
+    return *rest != '\0';
+  }
+
+  for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); ++i) {
+    if (n == strlen(cmds[i]) && !strncmp(ptr, cmds[i], n)) {
+      return *rest == '\0';
+    }
+  }
+
+  return false;
+}
+
+static
+bool
+is_block_end(const char *line) {
+  const char *ptr = skip_spaces(line);
+
+  return !strncmp(ptr, "end", 3) && *skip_spaces(ptr + 3) == '\0';
+}
+
+/*
+ * Check the commands, settings and convenience variables used by the script
+ * against every selected gdb version in a single pass over the lines. Names
+ * unknown to all versions are left to the other reports.
+ */
+static
+int
+report_incompatible(struct progdata *pdata, struct args *pargs, FILE *out) {
+  if (!pdata || !pargs || !out || !pdata->vindex.selected) {
+    return 0;
+  }
+
+  struct version_index *vindex = &pdata->vindex;
+  int count = 0;
+  bool raw_block = false;
+
+  for (size_t i = 0; i < pdata->linemap.count; i++) {
+    const char *line = pdata->linemap.lines[i].line;
+    size_t linenum = pdata->linemap.lines[i].orig_linenum;
+    char name[MAX_LEN];
+
+    /* Bodies of python and document blocks are not gdb commands */
+    if (raw_block) {
+      raw_block = !is_block_end(line);
+      continue;
+    }
+    raw_block = opens_raw_block(line);
+
+    /* Commands and settings at the start of each statement */
+    for (const char *stmt = line; stmt;) {
+      stmt = skip_spaces(stmt);
+
+      size_t n = name_span(stmt, false);
+      snprintf(name, sizeof(name), "%.*s", (int)n, stmt);
+
+      if (n && !is_gdb_keyword(name) && !is_number(name) &&
+          !is_script_def(pdata, name, FUNC)) {
+        unsigned int versions = find_command_versions(vindex->cmds, stmt, n);
+        unsigned int missing = vindex->selected & ~versions;
+
+        if (versions && missing) {
+          print_incompatible(pdata, pargs, out, linenum, "cmd", stmt, n,
+              missing);
+          ++count;
+
+        } else if (
+          versions &&
+          ((n == 3 && !strncmp(stmt, "set", 3)) ||
+           (n == 4 && !strncmp(stmt, "show", 4)))
+        ) {
+          /* Longest setting known to any version, "print pretty" */
+          const char *setting = skip_spaces(stmt + n);
+          const char *end = setting;
+          unsigned int setting_versions = 0;
+
+          for (const char *ptr = setting; (n = name_span(ptr, false));) {
+            snprintf(name, sizeof(name), "%.*s",
+                (int)(ptr + n - setting), setting);
+
+            unsigned int found = find_symbol_versions(&vindex->settings, name);
+            if (!found) {
+              break;
+            }
+
+            setting_versions = found;
+            end = ptr + n;
+            ptr = skip_spaces(end);
+          }
+
+          missing = vindex->selected & ~setting_versions;
+          if (setting_versions && missing) {
+            print_incompatible(pdata, pargs, out, linenum, "setting",
+                setting, end - setting, missing);
+            ++count;
+          }
+        }
+      }
+
+      if (n == 6 && !strncmp(stmt, "python", 6)) {
+        break;
+      }
+
+      if ((stmt = index(stmt, ';'))) {
+        ++stmt;
+      }
+    }
+
+    /* Convenience variables */
+    for (const char *ptr = line; (ptr = index(ptr, '$')); ) {
+      size_t n = name_span(++ptr, false);
+      if (!n) {
+        continue;
+      }
+
+      snprintf(name, sizeof(name), "%.*s", (int)n, ptr);
+
+      if (!is_script_def(pdata, name, VAR)) {
+        unsigned int versions = find_symbol_versions(&vindex->vars, name);
+        unsigned int missing = vindex->selected & ~versions;
+
+        if (versions && missing) {
+          print_incompatible(pdata, pargs, out, linenum, "var", ptr, n,
+              missing);
+          ++count;
+        }
+      }
+
+      ptr += n;
+    }
+  }
+
+  return count;
+}
+
+static
+int
+report_issues(struct progdata *pdata, struct args *pargs, FILE *out) {
+  if(!pargs || !out) {
+    return 0;
+  }
+
+  return report_undefined(pdata, pargs, out) +
+    report_unused(pdata, pargs, out) +
+    report_incompatible(pdata, pargs, out);
+}
+
+/* With -s the reports of every linted script go into a single bash array */
+static
+void
+open_reports(struct args *pargs) {
+  if (pargs->action == SCRIPTABLE) {
+    printf("export GDBLINT_REPORTS=(\\\n");
+  }
+}
+
+static
+void
+close_reports(struct args *pargs) {
+  if (pargs->action == SCRIPTABLE) {
+    printf(");\n");
+  }
+}
+
+/* Engines */
+
+static
+void
+extract_symbols(struct progdata *pdata, enum engine_type engine) {
+  if (engine == FAST) {
+    extract_defs_fast(pdata);
+    extract_refs_fast(pdata);
+  } else {
+    extract_defs(pdata);
+    extract_refs(pdata);
+  }
+}
+
+static
+void
+report_divergence(struct args *pargs, const char *fmt, ...) {
+  va_list ap;
+
+  if (pargs->action == SCRIPTABLE) {
+    printf("  \"");
+  }
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+
+  if (pargs->action == SCRIPTABLE) {
+    printf("\\n\"\\\n");
+  } else {
+    putchar('\n');
+  }
+}
+
+static
+size_t
+count_symbol(struct symbol *entry, const struct symbol *sym,
+    const struct symbol *stop) {
+
+  size_t n = 0;
+
+  for (; entry && entry != stop; entry = entry->next) {
+    if (entry->type == sym->type && entry->linenum == sym->linenum &&
+        entry->id == sym->id) {
+      ++n;
+    }
+  }
+
+  return n;
+}
+
+/* Compare two maps as multisets of (name, type, line) */
+static
+int
+diff_maps(struct hash_map *legacy, struct hash_map *fast, const char *mapname,
+    struct progdata *pdata, struct args *pargs) {
+
+  int count = 0;
+
+  for (size_t i = 0; i < HASH_SIZE; i++) {
+    for (int pass = 0; pass < 2; ++pass) {
+      struct symbol *head = pass ? fast->table[i] : legacy->table[i];
+      struct symbol *other = pass ? legacy->table[i] : fast->table[i];
+
+      for (struct symbol *sym = head; sym; sym = sym->next) {
+        /* Symbols from gdb are identical in both maps */
+        if (!sym->linenum || count_symbol(head, sym, sym)) {
+          continue;
+        }
+
+        size_t n = count_symbol(sym, sym, NULL);
+        size_t nother = count_symbol(other, sym, NULL);
+        if (n == nother || (pass && nother)) {
+          continue;
+        }
+
+        report_divergence(
+          pargs,
+          "%s:%.*ld: "
+          "Engine divergence: %s %s '%s' found %lu time(s) by legacy, "
+          "%lu by fast",
+          pargs->gdbfile ? basename(pargs->gdbfile) : "STDIN",
+          pdata->linenum_width, sym->linenum, mapname,
+          sym->type == FUNC ? "func" : sym->type == VAR ? "var" : NULL,
+          interned_string(sym->id), pass ? nother : n, pass ? n : nother
+        );
+
+        ++count;
+      }
+    }
+  }
+
+  return count;
+}
+
+static
+int
+compare_lines(const void *a, const void *b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* Render the diagnostics of an engine as a sorted array of lines */
+static
+char**
+render_issues(struct progdata *pdata, struct args *pargs, char **buffer,
+    size_t *nlines) {
+
+  size_t size = 0;
+  FILE *fp = open_memstream(buffer, &size);
+  if (!fp) {
+    err("open_memstream failed: %s\n", strerror(errno));
+    return NULL;
+  }
+
+  struct args args = *pargs;
+  args.action = LINT;
+
+  /* Rendering for comparison is not reporting */
+  size_t diagnostics[NRULES];
+  memcpy(diagnostics, metrics()->diagnostics, sizeof(diagnostics));
+
+  report_issues(pdata, &args, fp);
+  fclose(fp);
+
+  memcpy(metrics()->diagnostics, diagnostics, sizeof(diagnostics));
+
+  *nlines = 0;
+  for (char *ptr = *buffer; (ptr = index(ptr, '\n')); ++ptr) {
+    ++*nlines;
+  }
+
+  char **lines = (char**)malloc((*nlines + 1) * sizeof(char*));
+  if (!lines) {
+    err("malloc failed: error: %s\n", strerror(errno));
+    return NULL;
+  }
+
+  char *ptr = *buffer;
+  for (size_t i = 0; i < *nlines; ++i) {
+    lines[i] = ptr;
+    ptr = index(ptr, '\n');
+    *ptr++ = '\0';
+  }
+
+  qsort(lines, *nlines, sizeof(char*), compare_lines);
+
+  return lines;
+}
+
+static
+int
+diff_issues(struct progdata *legacy, struct progdata *fast,
+    struct args *pargs) {
+
+  char *legacy_buffer = NULL, *fast_buffer = NULL;
+  size_t nlegacy = 0, nfast = 0;
+
+  char **legacy_lines = render_issues(legacy, pargs, &legacy_buffer, &nlegacy);
+  char **fast_lines = render_issues(fast, pargs, &fast_buffer, &nfast);
+
+  int count = 0;
+
+  for (size_t i = 0, j = 0; legacy_lines && fast_lines &&
+       (i < nlegacy || j < nfast);) {
+    int cmp = i == nlegacy ? 1 : j == nfast ? -1 :
+      strcmp(legacy_lines[i], fast_lines[j]);
+
+    if (!cmp) {
+      ++i, ++j;
+      continue;
+    }
+
+    report_divergence(
+      pargs,
+      "%s: Engine divergence: diagnostic only reported by %s: %s",
+      pargs->gdbfile ? basename(pargs->gdbfile) : "STDIN",
+      cmp < 0 ? "legacy" : "fast",
+      cmp < 0 ? legacy_lines[i++] : fast_lines[j++]
+    );
+
+    ++count;
+  }
+
+  free(legacy_lines);
+  free(fast_lines);
+  free(legacy_buffer);
+  free(fast_buffer);
+
+  return count;
+}
+
+/*
+ * Run the legacy and the fast engines over the same lines and report every
+ * divergence in definitions, references and diagnostics.
+ */
+static
+int
+diff_engines(struct progdata *pdata, struct args *pargs) {
+  if (!pdata || !pargs) {
+    return 0;
+  }
+
+  struct progdata fast = { 0 };
+
+  fast.linemap = pdata->linemap;
+  fast.cmds = pdata->cmds;
+  fast.vindex = pdata->vindex;
+  fast.linenum_width = pdata->linenum_width;
+
+  init_map(&fast.defs);
+  init_map(&fast.refs);
+
+  for (size_t i = 0; i < HASH_SIZE; i++) {
+    for (struct symbol *def = pdata->defs.table[i]; def; def = def->next) {
+      insert_symbol(&fast.defs, def->id, def->linenum, def->type);
+    }
+  }
+
+  extract_symbols(pdata, LEGACY);
+  extract_symbols(&fast, FAST);
+
+  int count = diff_maps(&pdata->defs, &fast.defs, "def", pdata, pargs) +
+    diff_maps(&pdata->refs, &fast.refs, "ref", pdata, pargs) +
+    diff_issues(pdata, &fast, pargs);
+
+  destroy_map(&fast.defs);
+  destroy_map(&fast.refs);
+
+  return count;
+}
+
+static
+const char*
+set_arch(struct progdata *pdata, char *arch) {
+  if (!pdata) {
+    return arch;
+  }
+
+  arch = (char*)get_system_arch(arch);
+
+  for (size_t i = 0; arch && i < MAX_ARCHS; ++i) {
+    if (strstr(pdata->archlist[i], arch)) {
+      arch = pdata->archlist[i];
+      break;
+    }
+  }
+
+  return arch;
+}
+
+static
+FILE*
+get_gdbfp(const char *gdbfile) {
+  FILE *gdbfp = gdbfile ? fopen(gdbfile, "r") : stdin;
+  if (!gdbfp) {
+    err("fopen failed: %s\n", strerror(errno));
+    return NULL;
+  }
+  return gdbfp;
+}
+
+static
+FILE*
+setup_cache(bool clear) {
+  static FILE *cachefp = NULL;
+  static char cachefile[PATH_MAX] = { 0 };
+
+  do {
+    if (*cachefile) {
+      break;
+    }
+
+    int length = snprintf(cachefile, sizeof(cachefile), "/home/%s/.cache/",
+        getenv("USER"));
+
+    if (!access(cachefile, R_OK | W_OK | X_OK)) {
+      snprintf(cachefile, sizeof(cachefile) - length, "%s", progname(NULL));
+      break;
+    }
+
+    if (errno != ENOENT) {
+      err("access failed for path: %s error: %s\n", cachefile, strerror(errno));
+      return NULL;
+    }
+    if (mkdir(cachefile, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)) {
+      err("mkdir failed for path: %s error: %s\n", cachefile, strerror(errno));
+      return NULL;
+    }
+
+    if (!clear) {
+      break;
+    }
+
+    if (remove(cachefile) && errno != ENOENT) {
+      err("remove failed for path: %s error: %s\n", cachefile, strerror(errno));
+      return NULL;
+    }
+
+    printf("Definitions and commands cache has been removed\n");
+
+    ++metrics()->cache_invalidations;
+
+    return cachefp = NULL;
+
+  } while (0);
+
+  if (cachefp) {
+    return cachefp;
+  }
+
+  cachefp = fopen(cachefile, "r+");
+  if (!cachefp && errno == ENOENT) {
+    cachefp = fopen(cachefile, "w+");
+  }
+  if (!cachefp) {
+    err("fopen failed: %s\n", strerror(errno));
+    return NULL;
+  }
+
+  return cachefp;
+}
+
+static
+bool
+load_gdb_data(struct progdata *pdata, char *arch, bool list) {
+  if (!pdata) {
+    return false;
+  }
+
+  bool loaded = false;
+
+  if (!(loaded = load_gdb_arch(MAX_ARCHS, pdata->archlist))) {
+    return loaded;
+  }
+
+  if (list) {
+    printf("%s\n", get_print_header(progname(NULL)));
+    print_arch(pdata);
+    fputc('\n', stdout);
+
+    exit(EXIT_SUCCESS);
+  }
+
+  arch = (char*)set_arch(pdata, arch);
+  dbg("arch: %s\n", arch);
+
+  if (!(loaded = load_gdb_commands(pdata))) {
+    return loaded;
+  }
+  if (!(loaded = load_gdb_convenience_vars(pdata))) {
+    return loaded;
+  }
+  return (loaded = load_gdb_registers(pdata, arch));
+}
+
+static
+size_t
+store_maps(struct progdata *pdata, FILE *fp, size_t *pndefs, size_t *pnrefs,
+    size_t *pncmds) {
+
+  if (!pdata || !fp) {
+    return 0;
+  }
+
+  size_t ndefs = 0, nrefs = 0, ncmds = 0;
+
+  size_t nstore =
+    (ndefs = store_map(&pdata->defs, "defs", sizeof("defs") - 1, fp, NULL, 0));
+  dbg("nstore: %lu\n", nstore);
+  (void)(pndefs && (*pndefs = ndefs));
+
+  nstore +=
+    (nrefs = store_map(&pdata->refs, "refs", sizeof("refs") - 1, fp, NULL, 0));
+  dbg("nstore: %lu\n", nstore);
+  (void)(pnrefs && (*pnrefs = nrefs));
+
+  //nstore +=
+  //  (ncmds = store_map(&pdata->cmds, "cmds", sizeof("cmds"), fp, NULL, 0));
+  //dbg("nstore: %lu\n", nstore);
+  //(void)(pncmds && (*pncmds = ncmds));
+  nstore +=
+    (ncmds = store_trie(pdata->cmds, fp, NULL, 0));
+  dbg("nstore: %lu\n", nstore);
+  (void)(pncmds && (*pncmds = ncmds));
+
+  return nstore;
+}
+
+static
+size_t
+load_maps(struct progdata *pdata, FILE *fp, size_t ndefs, size_t nrefs,
+    size_t ncmds UNUSED) {
+
+  if (!pdata || !fp) {
+    return 0;
+  }
+
+  size_t nload =
+    load_map(&pdata->defs, "defs", sizeof("defs") - 1, fp, NULL, ndefs);
+  dbg("nload: %lu\n", nload);
+
+  nload += load_map(&pdata->refs, "refs", sizeof("refs") - 1, fp, NULL, nrefs);
+  dbg("nload: %lu\n", nload);
+
+  //nload += load_map(&pdata->cmds, "cmds", sizeof("cmds") - 1, fp, NULL, ncmds);
+  //dbg("nload: %lu\n", nload);
+
+  return nload;
+}
+
+/* Lint */
+
+/* Drop the lines, references and definitions of the last linted script */
+static
+void
+reset_script(struct progdata *pdata) {
+  if (!pdata) {
+    return;
+  }
+
+  pdata->linemap.count = 0;
+  pdata->linemap.max_linenum = 0;
+
+  destroy_map(&pdata->refs);
+
+  /* Keep the definitions loaded from gdb */
+  for (size_t i = 0; i < HASH_SIZE; ++i) {
+    for (struct symbol **link = &pdata->defs.table[i]; *link;) {
+      struct symbol *entry = *link;
+      if (entry->linenum) {
+        *link = entry->next;
+        free(entry);
+      } else {
+        link = &entry->next;
+      }
+    }
+  }
+}
+
+static
+void
+report_summary(struct args *pargs, int issues) {
+  char numbuf[16] = { '0', '\0' };
+  size_t w = 0;
+
+  for (int copy = issues; copy; ++w, copy /= 10);
+  if (w && w < sizeof(numbuf) - 1) {
+    numbuf[w] = '\0';
+
+    int copy = issues;
+    for (ssize_t i = w - 1; i >= 0; --i) {
+      numbuf[i] = (char)(copy % 10 + '0');
+      copy /= 10;
+    }
+  }
+
+  if (pargs->action == SCRIPTABLE) {
+    printf("export GDBLINT_NREPORTS=%s;\n", numbuf);
+  } else if (issues) {
+    printf("File: %s\nFound: %s %s\n", pargs->gdbfile, numbuf,
+        pargs->engine == DIFF ? "divergence(s)" : "issue(s)");
+  }
+}
+
+/* Report the diagnostics of one script, without opening or closing reports */
+static
+int
+lint_script(struct progdata *pdata, struct args *pargs, FILE *fp) {
+  if (!pdata || !pargs || !fp) {
+    return 0;
+  }
+
+  parse_gdbfile(pdata, fp);
+
+  int issues = 0;
+
+  if (pargs->engine == DIFF) {
+    issues = diff_engines(pdata, pargs);
+  } else {
+    extract_symbols(pdata, pargs->engine);
+    issues = report_issues(pdata, pargs, stdout);
+  }
+
+  reset_script(pdata);
+
+  return issues;
+}
+
+static
+int
+lint_file(struct progdata *pdata, struct args *pargs, FILE *fp) {
+  if (!pdata || !pargs || !fp) {
+    return 0;
+  }
+
+  open_reports(pargs);
+  int issues = lint_script(pdata, pargs, fp);
+  close_reports(pargs);
+
+  report_summary(pargs, issues);
+
+  return issues;
+}
+
+/* Git */
+
+static
+pid_t
+spawn_git(char *const argv[], FILE **in, FILE **out) {
+  int inpipe[2] = { -1, -1 }, outpipe[2] = { -1, -1 };
+
+  if ((in && pipe2(inpipe, O_CLOEXEC)) || pipe2(outpipe, O_CLOEXEC)) {
+    err("pipe2 failed: %s\n", strerror(errno));
+    return -1;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    err("fork failed: %s\n", strerror(errno));
+    return -1;
+  }
+
+  if (!pid) {
+    if ((in && dup2(inpipe[0], STDIN_FILENO) < 0) ||
+        dup2(outpipe[1], STDOUT_FILENO) < 0) {
+      _exit(127);
+    }
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+
+  if (in) {
+    close(inpipe[0]);
+    *in = fdopen(inpipe[1], "w");
+  }
+  close(outpipe[1]);
+  *out = fdopen(outpipe[0], "r");
+
+  return pid;
+}
+
+static
+bool
+wait_git(pid_t pid) {
+  int status = 0;
+
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      err("waitpid failed: %s\n", strerror(errno));
+      return false;
+    }
+  }
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* List the staged paths or the paths changed by a revision */
+static
+char*
+list_git_paths(struct args *pargs, size_t *len) {
+  static const char *default_pathspec = "*.gdb";
+
+  char *staged[] = {
+    "git", "diff", "--cached", "--name-only", "-z", "--diff-filter=ACMR", "--"
+  };
+  char *rev[] = {
+    "git", "diff-tree", "--root", "--no-commit-id", "--name-only", "-z", "-r",
+    "--diff-filter=ACMR", pargs->git_rev, "--"
+  };
+
+  char **cmd = pargs->git_rev ? rev : staged;
+  size_t ncmd = pargs->git_rev ?
+    sizeof(rev) / sizeof(rev[0]) : sizeof(staged) / sizeof(staged[0]);
+
+  size_t npathspecs = pargs->npathspecs ? pargs->npathspecs : 1;
+  char **argv = (char**)malloc((ncmd + npathspecs + 1) * sizeof(char*));
+  if (!argv) {
+    err("malloc failed: error: %s\n", strerror(errno));
+    return NULL;
+  }
+
+  memcpy(argv, cmd, ncmd * sizeof(char*));
+  for (size_t i = 0; i < npathspecs; ++i) {
+    argv[ncmd + i] = pargs->npathspecs ?
+      pargs->pathspecs[i] : (char*)default_pathspec;
+  }
+  argv[ncmd + npathspecs] = NULL;
+
+  FILE *out = NULL;
+  pid_t pid = spawn_git(argv, NULL, &out);
+  free(argv);
+
+  if (pid < 0 || !out) {
+    return NULL;
+  }
+
+  size_t cap = MAX_LEN;
+  char *paths = (char*)malloc(cap);
+  size_t nread = 0;
+
+  *len = 0;
+  while (paths && (nread = fread(paths + *len, 1, cap - *len, out)) > 0) {
+    if ((*len += nread) == cap) {
+      char *tmp = (char*)realloc(paths, cap <<= 1);
+      if (!tmp) {
+        free(paths);
+      }
+      paths = tmp;
+    }
+  }
+
+  fclose(out);
+
+  if (!wait_git(pid) || !paths) {
+    fprintf(stderr, "Could not list git paths\n");
+    free(paths);
+    return NULL;
+  }
+
+  return paths;
+}
+
+/*
+ * Lint the staged version, or the version at a revision, of every listed path.
+ * All blobs are streamed through a single 'git cat-file --batch' and linted
+ * from memory.
+ */
+static
+int
+lint_git(struct progdata *pdata, struct args *pargs) {
+  if (!pdata || !pargs) {
+    return -1;
+  }
+
+  size_t len = 0;
+  char *paths = list_git_paths(pargs, &len);
+  if (!paths) {
+    return -1;
+  }
+
+  char *argv[] = { "git", "cat-file", "--batch", NULL };
+  FILE *req = NULL, *resp = NULL;
+
+  pid_t pid = spawn_git(argv, &req, &resp);
+  if (pid < 0 || !req || !resp) {
+    free(paths);
+    return -1;
+  }
+
+  /* Report a dead git through the responses rather than a signal */
+  signal(SIGPIPE, SIG_IGN);
+
+  char *header = NULL;
+  size_t header_len = 0;
+  char *blob = NULL;
+  size_t blob_cap = 0;
+  int issues = 0;
+
+  open_reports(pargs);
+
+  for (char *path = paths; path < paths + len; path += strlen(path) + 1) {
+    if (index(path, '\n')) {
+      wrn("skipping path with newline: %s\n", path);
+      continue;
+    }
+
+    if (pargs->git_rev) {
+      fprintf(req, "%s:%s\n", pargs->git_rev, path);
+    } else {
+      fprintf(req, ":%s\n", path);
+    }
+    fflush(req);
+
+    if (getline(&header, &header_len, resp) <= 0) {
+      fprintf(stderr, "git cat-file exited early\n");
+      issues = -1;
+      break;
+    }
+
+    char type[32];
+    size_t size = 0;
+
+    /* Missing objects come without content */
+    if (sscanf(header, "%*s %31s %zu", type, &size) != 2) {
+      fprintf(stderr, "Skipping %s: %s", path, header);
+      continue;
+    }
+
+    /* Content is followed by a newline, read it even when skipped */
+    if (size + 1 > blob_cap) {
+      char *tmp = (char*)realloc(blob, blob_cap = size + 1);
+      if (!tmp) {
+        err("realloc failed: error: %s\n", strerror(errno));
+        issues = -1;
+        break;
+      }
+      blob = tmp;
+    }
+
+    if (fread(blob, 1, size + 1, resp) != size + 1) {
+      fprintf(stderr, "Short read from git cat-file for %s\n", path);
+      issues = -1;
+      break;
+    }
+
+    if (strcmp(type, "blob")) {
+      fprintf(stderr, "Skipping %s: %s", path, header);
+      continue;
+    }
+
+    if (!size) {
+      continue;
+    }
+
+    FILE *fp = fmemopen(blob, size, "r");
+    if (!fp) {
+      err("fmemopen failed: %s\n", strerror(errno));
+      continue;
+    }
+
+    pargs->gdbfile = path;
+    int found = lint_script(pdata, pargs, fp);
+    if (pargs->action != SCRIPTABLE) {
+      report_summary(pargs, found);
+    }
+    pargs->gdbfile = NULL;
+
+    issues += found;
+
+    fclose(fp);
+  }
+
+  fclose(req);
+  fclose(resp);
+
+  if (!wait_git(pid) && issues >= 0) {
+    fprintf(stderr, "git cat-file failed\n");
+    issues = -1;
+  }
+
+  /* One array and one count for all the scripts */
+  close_reports(pargs);
+  if (pargs->action == SCRIPTABLE) {
+    report_summary(pargs, issues > 0 ? issues : 0);
+  }
+
+  free(header);
+  free(blob);
+  free(paths);
+
+  return issues;
+}
+
+/* Repository wide unused definitions */
+
+/*
+ * Map: every script is reduced, in parallel, to a summary of its definitions
+ * and its distinct references. Summaries are cached by content hash, so only
+ * changed scripts are extracted again.
+ *
+ * Reduce: the references of all summaries are joined on interned names and
+ * the definitions never referenced anywhere are reported.
+ */
+
+#define SUMMARY_MAGIC "gdblint-summary 2"
+#define MAX_WORKERS 64
+
+struct summary_entry {
+  uint32_t id;
+  enum symbol_type type;
+  size_t linenum;
+};
+
+struct file_summary {
+  char *path;
+  size_t max_linenum;
+  struct summary_entry *defs;
+  size_t ndefs;
+  struct summary_entry *refs;
+  size_t nrefs;
+};
+
+struct summary_job {
+  struct file_summary *summaries;
+  size_t count;
+  atomic_size_t next;
+  const char *cachedir;
+  enum engine_type engine;
+};
+
+static
+uint64_t
+content_hash(const char *buffer, size_t len) {
+  uint64_t hash = 14695981039346656037ull;
+
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= (unsigned char)buffer[i];
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+static
+bool
+append_entry(struct summary_entry **entries, size_t *n, uint32_t id,
+    enum symbol_type type, size_t linenum) {
+
+  /* Grow at powers of two */
+  if (!(*n & (*n - 1))) {
+    struct summary_entry *tmp = (struct summary_entry*)realloc(*entries,
+        (*n ? *n << 1 : 1) * sizeof(struct summary_entry));
+    if (!tmp) {
+      return false;
+    }
+    *entries = tmp;
+  }
+
+  (*entries)[(*n)++] = (struct summary_entry){ id, type, linenum };
+
+  return true;
+}
+
+static
+bool
+load_summary(struct file_summary *summary, const char *cachefile) {
+  FILE *fp = fopen(cachefile, "r");
+  if (!fp) {
+    return false;
+  }
+
+  char line[MAX_LEN];
+  bool ret = fgets(line, sizeof(line), fp) &&
+    !strncmp(line, SUMMARY_MAGIC "\n", sizeof(SUMMARY_MAGIC)) &&
+    fgets(line, sizeof(line), fp) &&
+    sscanf(line, "lines,%zu", &summary->max_linenum) == 1;
+
+  while (ret && fgets(line, sizeof(line), fp)) {
+    char name[MAX_LEN];
+    int type = NONE;
+    size_t linenum = 0;
+
+    if (sscanf(line, "def,%d,%zu,%[^\n]", &type, &linenum, name) == 3 &&
+        (type == VAR || type == FUNC)) {
+      ret = append_entry(&summary->defs, &summary->ndefs, intern(name), type,
+          linenum);
+    } else if (sscanf(line, "ref,%d,%[^\n]", &type, name) == 2 &&
+        (type == VAR || type == FUNC)) {
+      ret = append_entry(&summary->refs, &summary->nrefs, intern(name), type,
+          0);
+    } else {
+      ret = false;
+    }
+  }
+
+  fclose(fp);
+
+  if (!ret) {
+    summary->ndefs = summary->nrefs = 0;
+  }
+
+  return ret;
+}
+
+static
+void
+store_summary(struct file_summary *summary, const char *cachefile) {
+  char tmpfile[PATH_MAX];
+  snprintf(tmpfile, sizeof(tmpfile), "%s.XXXXXX", cachefile);
+
+  int fd = mkstemp(tmpfile);
+  if (fd < 0) {
+    wrn("mkstemp failed for path: %s error: %s\n", tmpfile, strerror(errno));
+    return;
+  }
+
+  FILE *fp = fdopen(fd, "w");
+  if (!fp) {
+    close(fd);
+    unlink(tmpfile);
+    return;
+  }
+
+  fputs(SUMMARY_MAGIC "\n", fp);
+  fprintf(fp, "lines,%zu\n", summary->max_linenum);
+  for (size_t i = 0; i < summary->ndefs; ++i) {
+    fprintf(fp, "def,%d,%zu,%s\n", summary->defs[i].type,
+        summary->defs[i].linenum, interned_string(summary->defs[i].id));
+  }
+  for (size_t i = 0; i < summary->nrefs; ++i) {
+    fprintf(fp, "ref,%d,%s\n", summary->refs[i].type,
+        interned_string(summary->refs[i].id));
+  }
+
+  /* Concurrent writers of the same content race harmlessly */
+  if (fclose(fp) || rename(tmpfile, cachefile)) {
+    unlink(tmpfile);
+  }
+}
+
+/* Returns false when id and type are already in the set, ids are never 0 */
+static
+bool
+insert_ref_key(uint64_t *set, size_t mask, uint32_t id,
+    enum symbol_type type) {
+  uint64_t key = (uint64_t)id << 2 | type;
+  size_t slot = (size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+
+  for (; set[slot]; slot = (slot + 1) & mask) {
+    if (set[slot] == key) {
+      return false;
+    }
+  }
+  set[slot] = key;
+
+  return true;
+}
+
+static
+bool
+extract_summary(struct file_summary *summary, char *buffer, size_t len,
+    enum engine_type engine) {
+
+  /*
+   * No gdb commands, so that references do not depend on the installed gdb
+   * and summaries can be cached by content alone.
+   */
+  struct progdata pdata = { 0 };
+
+  FILE *fp = fmemopen(buffer, len, "r");
+  if (!fp) {
+    return false;
+  }
+
+  parse_gdbfile(&pdata, fp);
+  fclose(fp);
+
+  extract_symbols(&pdata, engine == FAST ? FAST : LEGACY);
+
+  summary->max_linenum = pdata.linemap.max_linenum;
+
+  /* References are deduplicated through a set at most half full */
+  size_t nrefs = 0;
+  for (size_t i = 0; i < HASH_SIZE; ++i) {
+    for (struct symbol *ref = pdata.refs.table[i]; ref; ref = ref->next) {
+      ++nrefs;
+    }
+  }
+
+  size_t setsize = 1;
+  while (setsize < nrefs * 2) {
+    setsize <<= 1;
+  }
+
+  uint64_t *seen = (uint64_t*)calloc(setsize, sizeof(uint64_t));
+  bool ret = seen != NULL;
+
+  for (size_t i = 0; ret && i < HASH_SIZE; ++i) {
+    for (struct symbol *def = pdata.defs.table[i]; ret && def;
+         def = def->next) {
+      ret = append_entry(&summary->defs, &summary->ndefs, def->id,
+          def->type, def->linenum);
+    }
+
+    for (struct symbol *ref = pdata.refs.table[i]; ret && ref;
+         ref = ref->next) {
+      if (insert_ref_key(seen, setsize - 1, ref->id, ref->type)) {
+        ret = append_entry(&summary->refs, &summary->nrefs, ref->id,
+            ref->type, 0);
+      }
+    }
+  }
+
+  free(seen);
+  free(pdata.linemap.lines);
+  destroy_map(&pdata.defs);
+  destroy_map(&pdata.refs);
+
+  return ret;
+}
+
+static
+void
+summarize_file(struct summary_job *job, struct file_summary *summary) {
+  FILE *fp = fopen(summary->path, "r");
+  if (!fp) {
+    wrn("fopen failed for path: %s error: %s\n", summary->path,
+        strerror(errno));
+    return;
+  }
+
+  char *buffer = NULL;
+  size_t size = 0;
+  size_t len = 0;
+  size_t nread = 0;
+
+  do {
+    if (len == size) {
+      char *tmp = (char*)realloc(buffer, size = size ? size << 1 : MAX_LEN);
+      if (!tmp) {
+        break;
+      }
+      buffer = tmp;
+    }
+    len += (nread = fread(buffer + len, 1, size - len, fp));
+  } while (nread);
+
+  fclose(fp);
+
+  char cachefile[PATH_MAX] = "";
+  if (job->cachedir) {
+    snprintf(cachefile, sizeof(cachefile), "%s/%016llx", job->cachedir,
+        (unsigned long long)content_hash(buffer, len));
+  }
+
+  if (len && (!*cachefile || !load_summary(summary, cachefile)) &&
+      extract_summary(summary, buffer, len, job->engine) && *cachefile) {
+    store_summary(summary, cachefile);
+  }
+
+  free(buffer);
+}
 
-        if (pargs->action == SCRIPTABLE) {
-          printf("\\n\"\\\n");
-        } else {
-          putchar('\n');
-        }
+static
+void*
+summary_worker(void *arg) {
+  struct summary_job *job = (struct summary_job*)arg;
 
-        ++count;
-      }
-    }
+  for (
+      size_t i = atomic_fetch_add(&job->next, 1);
+      i < job->count;
+      i = atomic_fetch_add(&job->next, 1)
+    ) {
+    summarize_file(job, &job->summaries[i]);
   }
 
-  return count;
+  return NULL;
 }
 
+static struct {
+  char **paths;
+  size_t count;
+  size_t capacity;
+} global_paths;
+
 static
 int
-report_issues(struct progdata *pdata, struct args *pargs) {
-  if(!pargs) {
+collect_path(const char *path, const struct stat *sb UNUSED, int flag,
+    struct FTW *ftwbuf UNUSED) {
+
+  size_t len = strlen(path);
+  if (flag != FTW_F || len < sizeof(".gdb") ||
+      strcmp(path + len - (sizeof(".gdb") - 1), ".gdb")) {
     return 0;
   }
 
-  if (pargs->action == SCRIPTABLE) {
-    printf("export GDBLINT_REPORTS=(\\\n");
+  if (global_paths.count == global_paths.capacity) {
+    size_t capacity = global_paths.capacity ? global_paths.capacity << 1 : 64;
+    char **tmp = (char**)realloc(global_paths.paths,
+        capacity * sizeof(char*));
+    if (!tmp) {
+      return -1;
+    }
+    global_paths.paths = tmp;
+    global_paths.capacity = capacity;
   }
 
-  int ret = report_undefined(pdata, pargs) + report_unused(pdata, pargs);
-
-  if (pargs->action == SCRIPTABLE) {
-    printf(");\n");
+  if (!(global_paths.paths[global_paths.count] = strdup(path))) {
+    return -1;
   }
+  ++global_paths.count;
 
-  return ret;
+  return 0;
 }
 
 static
 const char*
-set_arch(struct progdata *pdata, char *arch) {
-  if (!pdata) {
-    return arch;
+setup_summary_cache(void) {
+  static char cachedir[PATH_MAX] = "";
+
+  /* Next to the defs and commands cache of setup_cache() */
+  const char *user = getenv("USER");
+  if (!user) {
+    return NULL;
   }
 
-  arch = (char*)get_system_arch(arch);
+  snprintf(cachedir, sizeof(cachedir), "/home/%s/.cache", user);
+  if (mkdir(cachedir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) &&
+      errno != EEXIST) {
+    return NULL;
+  }
 
-  for (size_t i = 0; arch && i < MAX_ARCHS; ++i) {
-    if (strstr(pdata->archlist[i], arch)) {
-      arch = pdata->archlist[i];
-      break;
-    }
+  snprintf(cachedir, sizeof(cachedir), "/home/%s/.cache/%s-summaries", user,
+      progname(NULL) ? progname(NULL) : "gdblint");
+  if (mkdir(cachedir, S_IRWXU) && errno != EEXIST) {
+    wrn("mkdir failed for path: %s error: %s\n", cachedir, strerror(errno));
+    return NULL;
   }
 
-  return arch;
+  return cachedir;
 }
 
 static
-FILE*
-get_gdbfp(const char *gdbfile) {
-  FILE *gdbfp = gdbfile ? fopen(gdbfile, "r") : stdin;
-  if (!gdbfp) {
-    err("fopen failed: %s\n", strerror(errno));
-    return NULL;
+int
+compare_entries(const void *a, const void *b) {
+  const struct summary_entry *lhs = (const struct summary_entry*)a;
+  const struct summary_entry *rhs = (const struct summary_entry*)b;
+
+  if (lhs->linenum != rhs->linenum) {
+    return lhs->linenum < rhs->linenum ? -1 : 1;
   }
-  return gdbfp;
+
+  int cmp = strcmp(interned_string(lhs->id), interned_string(rhs->id));
+  if (cmp) {
+    return cmp;
+  }
+
+  return (int)lhs->type - (int)rhs->type;
 }
 
 static
-FILE*
-setup_cache(bool clear) {
-  static FILE *cachefp = NULL;
-  static char cachefile[PATH_MAX] = { 0 };
+int
+report_global_unused(struct file_summary *summaries, size_t count,
+    struct args *pargs) {
 
-  do {
-    if (*cachefile) {
-      break;
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; j < summaries[i].nrefs; ++j) {
+      struct summary_entry *ref = &summaries[i].refs[j];
+      symbol_marks[ref->type][ref->id / CHAR_BIT] |= 1u << (ref->id % CHAR_BIT);
     }
+  }
 
-    int length = snprintf(cachefile, sizeof(cachefile), "/home/%s/.cache/",
-        getenv("USER"));
+  int issues = 0;
 
-    if (!access(cachefile, R_OK | W_OK | X_OK)) {
-      snprintf(cachefile, sizeof(cachefile) - length, "%s", progname(NULL));
-      break;
+  /* Summaries are in path order, definitions follow in line order */
+  for (size_t i = 0; i < count; ++i) {
+    if (summaries[i].ndefs > 1) {
+      qsort(summaries[i].defs, summaries[i].ndefs,
+          sizeof(struct summary_entry), compare_entries);
     }
 
-    if (errno != ENOENT) {
-      err("access failed for path: %s error: %s\n", cachefile, strerror(errno));
-      return NULL;
-    }
-    if (mkdir(cachefile, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)) {
-      err("mkdir failed for path: %s error: %s\n", cachefile, strerror(errno));
-      return NULL;
-    }
+    int width = linenum_width(summaries[i].max_linenum);
 
-    if (!clear) {
-      break;
-    }
+    for (size_t j = 0; j < summaries[i].ndefs; ++j) {
+      struct summary_entry *def = &summaries[i].defs[j];
 
-    if (remove(cachefile) && errno != ENOENT) {
-      err("remove failed for path: %s error: %s\n", cachefile, strerror(errno));
-      return NULL;
-    }
+      if ((def->type == FUNC && pargs->no_warn_unused_func) ||
+          (def->type == VAR && pargs->no_warn_unused_var) ||
+          is_marked(def->id, def->type)) {
+        continue;
+      }
 
-    printf("Definitions and commands cache has been removed\n");
+      if (pargs->action == SCRIPTABLE) {
+        printf("  \"");
+      }
 
-    return cachefp = NULL;
+      printf(
+        "%s:%.*ld: "
+        "Unused %s: '%s' defined at line %ld is never used in %s",
+        summaries[i].path, width, def->linenum,
+        def->type == FUNC ? "func" : "var",
+        interned_string(def->id), def->linenum, pargs->global_unused
+      );
 
-  } while (0);
+      if (pargs->action == SCRIPTABLE) {
+        printf("\\n\"\\\n");
+      } else {
+        putchar('\n');
+      }
 
-  if (cachefp) {
-    return cachefp;
+      ++metrics()->diagnostics[
+        def->type == FUNC ? RULE_UNUSED_FUNC : RULE_UNUSED_VAR
+      ];
+      ++issues;
+    }
   }
 
-  cachefp = fopen(cachefile, "r+");
-  if (!cachefp && errno == ENOENT) {
-    cachefp = fopen(cachefile, "w+");
-  }
-  if (!cachefp) {
-    err("fopen failed: %s\n", strerror(errno));
-    return NULL;
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; j < summaries[i].nrefs; ++j) {
+      struct summary_entry *ref = &summaries[i].refs[j];
+      symbol_marks[ref->type][ref->id / CHAR_BIT] = 0;
+    }
   }
 
-  return cachefp;
+  return issues;
 }
 
 static
-bool
-load_gdb_data(struct progdata *pdata, char *arch, bool list) {
-  if (!pdata) {
-    return false;
+int
+compare_paths(const void *a, const void *b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static
+int
+lint_global_unused(struct args *pargs) {
+  if (!pargs || !pargs->global_unused) {
+    return -1;
   }
 
-  bool loaded = false;
+  if (pargs->no_warn_unused) {
+    return 0;
+  }
 
-  if (!(loaded = load_gdb_arch(MAX_ARCHS, pdata->archlist))) {
-    return loaded;
+  if (nftw(pargs->global_unused, collect_path, 32, FTW_PHYS)) {
+    err("nftw failed for path: %s error: %s\n", pargs->global_unused,
+        strerror(errno));
+    fprintf(stderr, "Could not list scripts in %s\n", pargs->global_unused);
+    return -1;
   }
 
-  if (list) {
-    printf("%s\n", get_print_header(progname(NULL)));
-    print_arch(pdata);
-    fputc('\n', stdout);
+  qsort(global_paths.paths, global_paths.count, sizeof(char*), compare_paths);
 
-    exit(EXIT_SUCCESS);
+  struct summary_job job = { 0 };
+  job.count = global_paths.count;
+  job.cachedir = setup_summary_cache();
+  job.engine = pargs->engine;
+  atomic_init(&job.next, 0);
+
+  job.summaries = (struct file_summary*)calloc(job.count + 1,
+      sizeof(struct file_summary));
+  if (!job.summaries) {
+    err("calloc failed: error: %s\n", strerror(errno));
+    return -1;
   }
 
-  arch = (char*)set_arch(pdata, arch);
-  dbg("arch: %s\n", arch);
+  for (size_t i = 0; i < job.count; ++i) {
+    job.summaries[i].path = global_paths.paths[i];
+  }
 
-  if (!(loaded = load_gdb_commands(pdata))) {
-    return loaded;
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t nworkers = ncpus > 0 ? (size_t)ncpus : 1;
+  if (nworkers > MAX_WORKERS) {
+    nworkers = MAX_WORKERS;
   }
-  if (!(loaded = load_gdb_convenience_vars(pdata))) {
-    return loaded;
+  if (nworkers > job.count) {
+    nworkers = job.count;
   }
-  return (loaded = load_gdb_registers(pdata, arch));
-}
 
-static
-size_t
-store_maps(struct progdata *pdata, FILE *fp, size_t *pndefs, size_t *pnrefs,
-    size_t *pncmds) {
+  pthread_t workers[MAX_WORKERS];
+  size_t nstarted = 0;
 
-  if (!pdata || !fp) {
-    return 0;
+  for (; nstarted < nworkers; ++nstarted) {
+    if (pthread_create(&workers[nstarted], NULL, summary_worker, &job)) {
+      break;
+    }
   }
 
-  size_t ndefs = 0, nrefs = 0, ncmds = 0;
-
-  size_t nstore =
-    (ndefs = store_map(&pdata->defs, "defs", sizeof("defs") - 1, fp, NULL, 0));
-  dbg("nstore: %lu\n", nstore);
-  (void)(pndefs && (*pndefs = ndefs));
-
-  nstore +=
-    (nrefs = store_map(&pdata->refs, "refs", sizeof("refs") - 1, fp, NULL, 0));
-  dbg("nstore: %lu\n", nstore);
-  (void)(pnrefs && (*pnrefs = nrefs));
-
-  //nstore +=
-  //  (ncmds = store_map(&pdata->cmds, "cmds", sizeof("cmds"), fp, NULL, 0));
-  //dbg("nstore: %lu\n", nstore);
-  //(void)(pncmds && (*pncmds = ncmds));
-  nstore +=
-    (ncmds = store_trie(pdata->cmds, fp, NULL, 0));
-  dbg("nstore: %lu\n", nstore);
-  (void)(pncmds && (*pncmds = ncmds));
-
-  return nstore;
-}
-
-static
-size_t
-load_maps(struct progdata *pdata, FILE *fp, size_t ndefs, size_t nrefs,
-    size_t ncmds UNUSED) {
+  /* The calling thread works too, so the job completes without workers */
+  summary_worker(&job);
 
-  if (!pdata || !fp) {
-    return 0;
+  for (size_t i = 0; i < nstarted; ++i) {
+    pthread_join(workers[i], NULL);
   }
 
-  size_t nload =
-    load_map(&pdata->defs, "defs", sizeof("defs") - 1, fp, NULL, ndefs);
-  dbg("nload: %lu\n", nload);
-
-  nload += load_map(&pdata->refs, "refs", sizeof("refs") - 1, fp, NULL, nrefs);
-  dbg("nload: %lu\n", nload);
+  open_reports(pargs);
+  int issues = report_global_unused(job.summaries, job.count, pargs);
+  close_reports(pargs);
 
-  //nload += load_map(&pdata->cmds, "cmds", sizeof("cmds") - 1, fp, NULL, ncmds);
-  //dbg("nload: %lu\n", nload);
+  for (size_t i = 0; i < job.count; ++i) {
+    free(job.summaries[i].defs);
+    free(job.summaries[i].refs);
+    free(job.summaries[i].path);
+  }
+  free(job.summaries);
+  free(global_paths.paths);
+  memset(&global_paths, 0, sizeof(global_paths));
 
-  return nload;
+  return issues;
 }
 
 static
@@ -1980,7 +4433,29 @@ print_help(FILE *file, struct progdata *pdata, const char *progname) {
     "\t--wno-undefined-function\n"
     "\t\tDisable warnings for undefined functions\n"
     "\t--wno-undefined-variable\n"
-    "\t\tDisable warnings for undefined variables\n",
+    "\t\tDisable warnings for undefined variables\n"
+    "\t--engine=legacy|fast|diff\n"
+    "\t\tSelect the engine extracting definitions and references, diff\n"
+    "\t\truns both and reports any divergence in their output\n"
+    "\t--metrics-file PATH\n"
+    "\t\tMerge cache, gdb and lint metrics of this run into a\n"
+    "\t\tPrometheus text format file\n"
+    "\t--save-snapshot PATH\n"
+    "\t\tStore the commands, settings and convenience variables of the\n"
+    "\t\tinstalled GDB as a snapshot\n"
+    "\t--snapshot PATH\n"
+    "\t\tImport a GDB snapshot, may be given once per GDB version\n"
+    "\t--gdb-versions=LIST\n"
+    "\t\tComma separated GDB versions to check the script against, all\n"
+    "\t\timported snapshots are used by default\n"
+    "\t--git-staged [PATHSPEC...]\n"
+    "\t\tLint the staged version of the staged GDB scripts, *.gdb\n"
+    "\t\tunless pathspecs are given\n"
+    "\t--git-rev REV [PATHSPEC...]\n"
+    "\t\tLint the version at REV of the GDB scripts changed by REV\n"
+    "\t--global-unused DIR\n"
+    "\t\tReport functions and variables defined in the GDB scripts under\n"
+    "\t\tDIR and never used by any of them\n",
     get_print_header(progname), progname
   );
 
@@ -2009,6 +4484,14 @@ parse_args(int argc, char *argv[], struct progdata *pdata, struct args *pargs) {
     {"wno-unused-variable", no_argument, NULL, 1 << 4},
     {"wno-undefined-function", no_argument, NULL, 1 << 5},
     {"wno-undefined-variable", no_argument, NULL, 1 << 6},
+    {"engine", required_argument, NULL, 1 << 7},
+    {"metrics-file", required_argument, NULL, 1 << 8},
+    {"snapshot", required_argument, NULL, 1 << 9},
+    {"save-snapshot", required_argument, NULL, 1 << 10},
+    {"gdb-versions", required_argument, NULL, 1 << 11},
+    {"git-staged", no_argument, NULL, 1 << 12},
+    {"git-rev", required_argument, NULL, 1 << 13},
+    {"global-unused", required_argument, NULL, 1 << 14},
     {0, 0, 0, 0}
   };
 
@@ -2068,6 +4551,64 @@ parse_args(int argc, char *argv[], struct progdata *pdata, struct args *pargs) {
         break;
       }
 
+      case 1 << 8: {
+        pargs->metrics_file = optarg;
+        break;
+      }
+
+      case 1 << 9: {
+        if (pargs->nsnapshots == MAX_VERSIONS) {
+          fprintf(stderr, "At most %d snapshots can be imported\n",
+              MAX_VERSIONS);
+          return EXIT_FAILURE;
+        }
+        pargs->snapshots[pargs->nsnapshots++] = optarg;
+        break;
+      }
+
+      case 1 << 10: {
+        pargs->action = SAVE_SNAPSHOT;
+        pargs->snapshot_file = optarg;
+        break;
+      }
+
+      case 1 << 11: {
+        pargs->gdb_versions = optarg;
+        break;
+      }
+
+      case 1 << 12: {
+        pargs->git_staged = true;
+        break;
+      }
+
+      case 1 << 13: {
+        pargs->git_rev = optarg;
+        break;
+      }
+
+      case 1 << 14: {
+        pargs->global_unused = optarg;
+        break;
+      }
+
+      case 1 << 7: {
+        if (!strcmp(optarg, "legacy")) {
+          pargs->engine = LEGACY;
+          break;
+        }
+        if (!strcmp(optarg, "fast")) {
+          pargs->engine = FAST;
+          break;
+        }
+        if (!strcmp(optarg, "diff")) {
+          pargs->engine = DIFF;
+          break;
+        }
+
+        fprintf(stderr, "Invalid engine: %s\n", optarg);
+      }
+
       default: {
         fputc('\n', stderr);
       }
@@ -2081,7 +4622,12 @@ parse_args(int argc, char *argv[], struct progdata *pdata, struct args *pargs) {
     }
   }
 
-  if (optind < argc) {
+  if (pargs->git_staged || pargs->git_rev) {
+    pargs->pathspecs = argv + optind;
+    pargs->npathspecs = argc - optind;
+    pargs->gdbfile = NULL;
+
+  } else if (optind < argc) {
     if ((pargs->gdbfile = realpath(argv[optind], NULL)) == 0) {
       return EXIT_FAILURE;
     }
@@ -2107,8 +4653,48 @@ main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
-  FILE *gdbfp = get_gdbfp(args.gdbfile);
-  if (!gdbfp) {
+  if (args.action == SAVE_SNAPSHOT) {
+    return save_snapshot(args.snapshot_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < args.nsnapshots; ++i) {
+    if (!load_snapshot(&data.vindex, args.snapshots[i])) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (args.gdb_versions && !args.nsnapshots) {
+    fprintf(stderr, "--gdb-versions requires --snapshot\n");
+    return EXIT_FAILURE;
+  }
+
+  if (!select_versions(&data.vindex, args.gdb_versions)) {
+    return EXIT_FAILURE;
+  }
+
+  if (args.global_unused) {
+    double start = monotonic_time();
+
+    int issues = lint_global_unused(&args);
+
+    metrics()->durations[PHASE_LINT] = monotonic_time() - start;
+
+    if (issues > 0 && args.action != SCRIPTABLE) {
+      printf("Directory: %s\nFound: %d issue(s)\n", args.global_unused,
+          issues);
+    } else if (args.action == SCRIPTABLE) {
+      printf("export GDBLINT_NREPORTS=%d;\n", issues > 0 ? issues : 0);
+    }
+
+    write_metrics(args.metrics_file);
+
+    return !issues ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  bool git = args.git_staged || args.git_rev;
+
+  FILE *gdbfp = git ? NULL : get_gdbfp(args.gdbfile);
+  if (!git && !gdbfp) {
     return EXIT_FAILURE;
   }
 
@@ -2121,14 +4707,22 @@ main(int argc, char *argv[]) {
   //  return EXIT_FAILURE;
   //}
 
+  double start = monotonic_time();
+
   FILE *cachefp = setup_cache((args.action == CLEAR_CACHE));
   if (!cachefp) {
+    write_metrics(args.metrics_file);
     return EXIT_FAILURE;
   }
 
   bool loaded = load_gdb_data(&data, args.arch, (args.action == LIST_ARCHS));
   dbg("loaded: %d\n", loaded);
-  (void)( !loaded && (loaded = (load_maps(&data, cachefp, 0, 0, 0) > 0)) );
+
+  /* The cache is only consulted when gdb could not be introspected */
+  if (!loaded) {
+    loaded = load_maps(&data, cachefp, 0, 0, 0) > 0;
+    ++*(loaded ? &metrics()->cache_hits : &metrics()->cache_misses);
+  }
 
   /***********************************/
   if (loaded && cachefp) {
@@ -2165,32 +4759,13 @@ main(int argc, char *argv[]) {
     cachefp = NULL;
   }
 
-  parse_gdbfile(&data, gdbfp);
-
-  extract_defs(&data);
-  extract_refs(&data);
-
-  int issues = report_issues(&data, &args);
+  metrics()->durations[PHASE_INTROSPECTION] = monotonic_time() - start;
+  start = monotonic_time();
 
-  char numbuf[16] = { '0', '\0' };
-  size_t w = 0;
-
-  for (int copy = issues; copy; ++w, copy /= 10);
-  if (w < sizeof(numbuf) - 1) {
-    numbuf[w] = '\0';
-
-    int copy = issues;
-    for (ssize_t i = w - 1; i >= 0; --i) {
-      numbuf[i] = (char)(copy % 10 + '0');
-      copy /= 10;
-    }
-  }
+  int issues = git ?
+    lint_git(&data, &args) : lint_file(&data, &args, gdbfp);
 
-  if (args.action == SCRIPTABLE) {
-    printf("export GDBLINT_NREPORTS=%s;\n", numbuf);
-  } else if (issues) {
-    printf("File: %s\nFound: %s issue(s)\n", args.gdbfile, numbuf);
-  }
+  metrics()->durations[PHASE_LINT] = monotonic_time() - start;
 
   if (args.gdbfile) {
     if (gdbfp != stdin) {
@@ -2207,6 +4782,8 @@ main(int argc, char *argv[]) {
   destroy_map(&data.refs);
   //destroy_map(&data.cmds);
 
+  write_metrics(args.metrics_file);
+
   return !issues ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
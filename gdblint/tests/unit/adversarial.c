@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2025  notweerdmonk
+ *
+ * This file is part of gdblint.
+ *
+ * Gdblint is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gdblint is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdblint.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @file adversarial.c
+ * @brief Unit test for prefix tree and report lookups on hostile input
+ */
+
+#include <src/gdblint.c>
+#include <assert.h>
+
+#define TEST_CASE(description, condition, message) \
+  do {\
+    puts("Test: "description);\
+    puts("Condition: "#condition); \
+    assert(condition && message);\
+    puts("Result: PASS\n");\
+  } while(0)
+
+int main() {
+  struct trie_node *cmds = NULL;
+  char cmd[MAX_COMMAND_LENGTH] = { 0 };
+  size_t cmdlen = 0;
+
+  insert_command(&cmds, "print");
+
+  /* Test insertion of commands outside the prefix tree alphabet */
+  TEST_CASE(
+      "Insert commands with bytes outside ASCII",
+      insert_command(&cmds, "caf\xc3\xa9") == NULL &&
+      insert_command(&cmds, "tab\tbed") == NULL &&
+      find_command(cmds, "print", cmd, &cmdlen) != NULL,
+      "Command with bytes outside ASCII inserted"
+    );
+
+  /* Test lookup of commands outside the prefix tree alphabet */
+  TEST_CASE(
+      "Find commands with bytes outside ASCII",
+      find_command(cmds, "\xff\xfe", cmd, &cmdlen) == NULL &&
+      find_command(cmds, "pr\x80", cmd, &cmdlen) == NULL,
+      "Command with bytes outside ASCII found"
+    );
+
+  destroy_tree(cmds);
+
+  /* Test reports over many distinct symbols */
+  struct progdata pdata = { 0 };
+  struct args pargs = { 0 };
+  char name[32];
+
+  init_map(&pdata.defs);
+  init_map(&pdata.refs);
+
+  for (size_t i = 1; i <= 4096; ++i) {
+    snprintf(name, sizeof(name), "v%lu", i);
+    insert_symbol(&pdata.defs, intern(name), i, VAR);
+    snprintf(name, sizeof(name), "v%lu", i + 1);
+    insert_symbol(&pdata.refs, intern(name), i, VAR);
+  }
+  insert_symbol(&pdata.refs, intern("v1"), 4097, FUNC);
+
+  FILE *out = fopen("/dev/null", "w");
+
+  TEST_CASE(
+      "Report unused and undefined symbols over many names",
+      out && report_unused(&pdata, &pargs, out) == 1 &&
+      report_undefined(&pdata, &pargs, out) == 2,
+      "Wrong number of issues reported"
+    );
+
+  /* Test marks are left clear for the next report */
+  TEST_CASE(
+      "Symbol marks cleared after reports",
+      !is_marked(intern_lookup("v2"), VAR) &&
+      !is_marked(intern_lookup("v1"), FUNC),
+      "Symbol marks left set"
+    );
+
+  /* Test reports follow line order whatever the interned ids */
+  char *text = NULL;
+  size_t textlen = 0;
+  FILE *mem = open_memstream(&text, &textlen);
+
+  insert_symbol(&pdata.defs, intern("late_first"), 9001, VAR);
+  insert_symbol(&pdata.defs, intern("early_second"), 5000, VAR);
+
+  TEST_CASE(
+      "Reports in line order",
+      mem && report_unused(&pdata, &pargs, mem) == 3 && !fclose(mem) &&
+      strstr(text, "'v1'") < strstr(text, "'early_second'") &&
+      strstr(text, "'early_second'") < strstr(text, "'late_first'"),
+      "Reports out of line order"
+    );
+
+  free(text);
+  fclose(out);
+  destroy_map(&pdata.defs);
+  destroy_map(&pdata.refs);
+
+  return 0;
+}
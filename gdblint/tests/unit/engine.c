@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2025  notweerdmonk
+ *
+ * This file is part of gdblint.
+ *
+ * Gdblint is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gdblint is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdblint.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @file engine.c
+ * @brief Unit test for the legacy and fast engines
+ */
+
+#include <src/gdblint.c>
+#include <assert.h>
+
+#define TEST_CASE(description, condition, message) \
+  do {\
+    puts("Test: "description);\
+    puts("Condition: "#condition); \
+    assert(condition && message);\
+    puts("Result: PASS\n");\
+  } while(0)
+
+static const char *script[] = {
+  "define helper",
+  "  set $count = $count + 1",
+  "end",
+  "python gdb.set_convenience_variable(\"pyvar\", 1)",
+  "helper $count; undefined_func arg # comment $hidden",
+  "x = $a$$b; print$c",
+};
+
+static
+void
+lint(struct progdata *pdata, enum engine_type engine) {
+  memset(pdata, 0, sizeof(*pdata));
+
+  for (size_t i = 0; i < sizeof(script) / sizeof(script[0]); ++i) {
+    insert_line(&pdata->linemap, script[i], i + 1);
+  }
+
+  extract_symbols(pdata, engine);
+}
+
+int main() {
+  struct progdata legacy, fast;
+  lint(&legacy, LEGACY);
+  lint(&fast, FAST);
+
+  struct args args = { 0 };
+  args.engine = DIFF;
+
+  /* Test definitions found by the fast engine */
+  TEST_CASE(
+      "Definitions from the fast engine",
+      find_symbol(&fast.defs, intern_lookup("helper"), FUNC) != NULL &&
+      find_symbol(&fast.defs, intern_lookup("count"), VAR) != NULL &&
+      find_symbol(&fast.defs, intern_lookup("pyvar"), VAR) != NULL,
+      "Definition not found"
+    );
+
+  /* Test references found by the fast engine */
+  TEST_CASE(
+      "References from the fast engine",
+      find_symbol(&fast.refs, intern_lookup("undefined_func"), FUNC) !=
+        NULL &&
+      find_symbol(&fast.refs, intern_lookup("b"), VAR) != NULL &&
+      find_symbol(&fast.refs, intern_lookup("hidden"), VAR) == NULL,
+      "Reference mismatch"
+    );
+
+  /* Test that both engines agree */
+  TEST_CASE(
+      "Equivalence of legacy and fast engines",
+      diff_maps(&legacy.defs, &fast.defs, "def", &legacy, &args) == 0 &&
+      diff_maps(&legacy.refs, &fast.refs, "ref", &legacy, &args) == 0 &&
+      diff_issues(&legacy, &fast, &args) == 0,
+      "Engines diverge"
+    );
+
+  /* Test that a divergence is detected */
+  insert_symbol(&fast.refs, intern("extra"), 5, VAR);
+  TEST_CASE(
+      "Detection of divergence",
+      diff_maps(&legacy.refs, &fast.refs, "ref", &legacy, &args) == 1,
+      "Divergence not detected"
+    );
+
+  free(legacy.linemap.lines);
+  free(fast.linemap.lines);
+  destroy_map(&legacy.defs);
+  destroy_map(&legacy.refs);
+  destroy_map(&fast.defs);
+  destroy_map(&fast.refs);
+
+  return 0;
+}
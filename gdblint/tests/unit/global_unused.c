@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2025  notweerdmonk
+ *
+ * This file is part of gdblint.
+ *
+ * Gdblint is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gdblint is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdblint.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @file global_unused.c
+ * @brief Unit test for repository wide unused definitions
+ */
+
+#include <src/gdblint.c>
+#include <assert.h>
+
+#define TEST_CASE(description, condition, message) \
+  do {\
+    puts("Test: "description);\
+    puts("Condition: "#condition); \
+    assert(condition && message);\
+    puts("Result: PASS\n");\
+  } while(0)
+
+static char library[] =
+  "define used_helper\n"
+  "end\n"
+  "define dead_helper\n"
+  "end\n"
+  "set $shared = 1\n";
+
+static char entry[] =
+  "used_helper\n"
+  "print $shared\n";
+
+int main() {
+  struct file_summary summaries[2] = {
+    { .path = "lib.gdb" }, { .path = "entry.gdb" }
+  };
+
+  /* Test the map phase */
+  TEST_CASE(
+      "Summarize scripts",
+      extract_summary(&summaries[0], library, sizeof(library) - 1, LEGACY) &&
+      extract_summary(&summaries[1], entry, sizeof(entry) - 1, LEGACY) &&
+      summaries[0].ndefs == 3 && summaries[1].ndefs == 0 &&
+      summaries[1].nrefs == 3,
+      "Summary mismatch"
+    );
+
+  /* Test the summary cache */
+  char cachefile[] = "/tmp/gdblint_summary_XXXXXX";
+  int fd = mkstemp(cachefile);
+  assert(fd >= 0);
+  close(fd);
+
+  struct file_summary cached = { .path = "lib.gdb" };
+  store_summary(&summaries[0], cachefile);
+
+  TEST_CASE(
+      "Load cached summary",
+      load_summary(&cached, cachefile) &&
+      cached.ndefs == summaries[0].ndefs &&
+      cached.nrefs == summaries[0].nrefs &&
+      cached.max_linenum == 5 && summaries[0].max_linenum == 5,
+      "Cached summary mismatch"
+    );
+
+  /* Test the reduce phase */
+  struct args args = { 0 };
+  args.global_unused = "DIR";
+
+  TEST_CASE(
+      "Report definitions unused in all scripts",
+      report_global_unused(summaries, 2, &args) == 1,
+      "Unused definition count mismatch"
+    );
+
+  /* Test definitions are reported in line order */
+  bool sorted = true;
+  for (size_t i = 1; i < summaries[0].ndefs; ++i) {
+    sorted = sorted &&
+      summaries[0].defs[i - 1].linenum <= summaries[0].defs[i].linenum;
+  }
+
+  TEST_CASE(
+      "Definitions in line order",
+      sorted,
+      "Definitions out of line order"
+    );
+
+  for (size_t i = 0; i < 2; ++i) {
+    free(summaries[i].defs);
+    free(summaries[i].refs);
+  }
+  free(cached.defs);
+  free(cached.refs);
+  unlink(cachefile);
+
+  return 0;
+}
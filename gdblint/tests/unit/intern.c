@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2025  notweerdmonk
+ *
+ * This file is part of gdblint.
+ *
+ * Gdblint is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gdblint is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdblint.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @file intern.c
+ * @brief Unit test for the string interner
+ */
+
+#include <src/gdblint.c>
+#include <assert.h>
+#include <pthread.h>
+
+#define TEST_CASE(description, condition, message) \
+  do {\
+    puts("Test: "description);\
+    puts("Condition: "#condition); \
+    assert(condition && message);\
+    puts("Result: PASS\n");\
+  } while(0)
+
+#define NTHREADS 8
+#define NNAMES 4096
+
+static uint32_t ids[NTHREADS][NNAMES];
+
+static
+void*
+intern_names(void *arg) {
+  uint32_t *out = (uint32_t*)arg;
+  char name[32];
+
+  for (size_t i = 0; i < NNAMES; ++i) {
+    snprintf(name, sizeof(name), "name_%zu", i);
+    out[i] = intern(name);
+  }
+
+  return NULL;
+}
+
+static
+bool
+same_ids(void) {
+  char name[32];
+
+  for (size_t i = 0; i < NNAMES; ++i) {
+    snprintf(name, sizeof(name), "name_%zu", i);
+
+    for (size_t t = 0; t < NTHREADS; ++t) {
+      if (!ids[t][i] || ids[t][i] != ids[0][i] ||
+          strcmp(interned_string(ids[t][i]), name)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int main() {
+  /* Test interning a string */
+  uint32_t id = intern("$rsp");
+  TEST_CASE(
+      "Intern a string",
+      id != 0 && intern("$rsp") == id && intern_lookup("$rsp") == id &&
+      !strcmp(interned_string(id), "$rsp"),
+      "Could not intern string"
+    );
+
+  /* Test lookup of a string never interned */
+  TEST_CASE(
+      "Lookup of a string never interned",
+      intern_lookup("printf") == 0,
+      "Errneous id found"
+    );
+
+  /* Test concurrent interning */
+  pthread_t threads[NTHREADS];
+  for (size_t t = 0; t < NTHREADS; ++t) {
+    pthread_create(&threads[t], NULL, intern_names, ids[t]);
+  }
+  for (size_t t = 0; t < NTHREADS; ++t) {
+    pthread_join(threads[t], NULL);
+  }
+
+  TEST_CASE(
+      "Concurrent interning",
+      same_ids(),
+      "Threads got different ids for the same string"
+    );
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2025  notweerdmonk
+ *
+ * This file is part of gdblint.
+ *
+ * Gdblint is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gdblint is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdblint.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @file metrics.c
+ * @brief Unit test for the metrics file
+ */
+
+#include <src/gdblint.c>
+#include <assert.h>
+
+#define TEST_CASE(description, condition, message) \
+  do {\
+    puts("Test: "description);\
+    puts("Condition: "#condition); \
+    assert(condition && message);\
+    puts("Result: PASS\n");\
+  } while(0)
+
+static
+double
+read_sample(const char *path, const char *sample) {
+  struct metric_series series = { 0 };
+  snprintf(series.sample, sizeof(series.sample), "%s", sample);
+
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    return -1;
+  }
+
+  merge_series(&series, 1, fp);
+  fclose(fp);
+
+  return series.value;
+}
+
+int main() {
+  char path[] = "/tmp/gdblint_metrics_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  unlink(path);
+
+  metrics()->gdb_spawns = 4;
+  metrics()->diagnostics[RULE_UNDEF_VAR] = 2;
+  metrics()->durations[PHASE_LINT] = 0.02;
+
+  /* Test creating the metrics file */
+  TEST_CASE(
+      "Create metrics file",
+      write_metrics(path) &&
+      read_sample(path, "gdblint_runs_total") == 1 &&
+      read_sample(path, "gdblint_gdb_spawns_total") == 4,
+      "Could not create metrics file"
+    );
+
+  /* Test merging into the metrics file */
+  TEST_CASE(
+      "Merge into metrics file",
+      write_metrics(path) &&
+      read_sample(path, "gdblint_runs_total") == 2 &&
+      read_sample(path,
+        "gdblint_diagnostics_total{rule=\"undefined-variable\"}") == 4,
+      "Counters not merged"
+    );
+
+  /* Test histogram buckets */
+  TEST_CASE(
+      "Phase duration histogram",
+      read_sample(path,
+        "gdblint_phase_duration_seconds_bucket{phase=\"lint\",le=\"0.01\"}")
+        == 0 &&
+      read_sample(path,
+        "gdblint_phase_duration_seconds_bucket{phase=\"lint\",le=\"0.05\"}")
+        == 2 &&
+      read_sample(path, "gdblint_phase_duration_seconds_count{phase=\"lint\"}")
+        == 2,
+      "Histogram mismatch"
+    );
+
+  char lockpath[PATH_MAX];
+  snprintf(lockpath, sizeof(lockpath), "%s.lock", path);
+  unlink(path);
+  unlink(lockpath);
+
+  return 0;
+}
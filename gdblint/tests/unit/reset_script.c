@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2025  notweerdmonk
+ *
+ * This file is part of gdblint.
+ *
+ * Gdblint is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gdblint is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdblint.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @file reset_script.c
+ * @brief Unit test for linting several scripts with one progdata
+ */
+
+#include <src/gdblint.c>
+#include <assert.h>
+
+#define TEST_CASE(description, condition, message) \
+  do {\
+    puts("Test: "description);\
+    puts("Condition: "#condition); \
+    assert(condition && message);\
+    puts("Result: PASS\n");\
+  } while(0)
+
+static char first[] =
+  "set $used = 1\n"
+  "set $unused = $used\n"
+  "print $_siginfo\n";
+
+static char second[] =
+  "set $other = $used\n";
+
+static
+int
+lint_buffer(struct progdata *pdata, struct args *pargs, char *buf) {
+  FILE *fp = fmemopen(buf, strlen(buf), "r");
+  assert(fp && "Could not open script buffer");
+
+  int issues = lint_script(pdata, pargs, fp);
+  fclose(fp);
+
+  return issues;
+}
+
+int main() {
+  struct progdata pdata = { 0 };
+  struct args pargs = { 0 };
+  pargs.engine = FAST;
+  pargs.gdbfile = "first.gdb";
+
+  init_map(&pdata.defs);
+  init_map(&pdata.refs);
+
+  /* Definitions loaded from gdb have no line number */
+  insert_symbol(&pdata.defs, intern("_siginfo"), 0, VAR);
+  insert_symbol(&pdata.defs, intern("print"), 0, FUNC);
+
+  /* Test reports of the first script */
+  TEST_CASE(
+      "Lint the first script",
+      lint_buffer(&pdata, &pargs, first) == 1,
+      "Wrong number of issues in the first script"
+    );
+
+  /* Test state left by the first script is cleared */
+  size_t nrefs = 0;
+  for (size_t i = 0; i < HASH_SIZE; ++i) {
+    nrefs += pdata.refs.table[i] != NULL;
+  }
+
+  TEST_CASE(
+      "Reset script state",
+      pdata.linemap.count == 0 && pdata.linemap.max_linenum == 0 &&
+      nrefs == 0 &&
+      find_symbol(&pdata.defs, intern_lookup("used"), VAR) == NULL &&
+      find_symbol(&pdata.defs, intern_lookup("unused"), VAR) == NULL,
+      "Script state left after reset"
+    );
+
+  /* Test definitions from gdb outlive the script */
+  TEST_CASE(
+      "Keep gdb definitions",
+      find_symbol(&pdata.defs, intern_lookup("_siginfo"), VAR) != NULL &&
+      find_symbol(&pdata.defs, intern_lookup("print"), FUNC) != NULL,
+      "Gdb definitions dropped by reset"
+    );
+
+  /* Test the second script does not see definitions of the first */
+  pargs.gdbfile = "second.gdb";
+  TEST_CASE(
+      "Lint the second script",
+      lint_buffer(&pdata, &pargs, second) == 2,
+      "Definitions leaked from the first script"
+    );
+
+  free(pdata.linemap.lines);
+  destroy_map(&pdata.defs);
+  destroy_map(&pdata.refs);
+
+  return 0;
+}
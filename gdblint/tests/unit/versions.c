@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2025  notweerdmonk
+ *
+ * This file is part of gdblint.
+ *
+ * Gdblint is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gdblint is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdblint.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @file versions.c
+ * @brief Unit test for the gdb version index
+ */
+
+#include <src/gdblint.c>
+#include <assert.h>
+
+#define TEST_CASE(description, condition, message) \
+  do {\
+    puts("Test: "description);\
+    puts("Condition: "#condition); \
+    assert(condition && message);\
+    puts("Result: PASS\n");\
+  } while(0)
+
+static
+void
+write_snapshot(char *path, const char *contents) {
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+
+  FILE *fp = fdopen(fd, "w");
+  assert(fp);
+  fputs(contents, fp);
+  fclose(fp);
+}
+
+int main() {
+  char old[] = "/tmp/gdblint_snapshot_XXXXXX";
+  char new[] = "/tmp/gdblint_snapshot_XXXXXX";
+
+  write_snapshot(old, "gdb 10\ncmd print\nset print pretty\nvar _exitcode\n");
+  write_snapshot(new, "gdb 15\ncmd print\ncmd pipe\nset print pretty\n"
+      "set logging enabled\nvar _exitcode\nvar _shell_exitcode\n");
+
+  struct progdata data = { 0 };
+  struct version_index *vindex = &data.vindex;
+
+  /* Test importing snapshots */
+  TEST_CASE(
+      "Import snapshots",
+      load_snapshot(vindex, old) && load_snapshot(vindex, new) &&
+      vindex->count == 2,
+      "Could not import snapshots"
+    );
+
+  /* Test version bitsets of the merged index */
+  TEST_CASE(
+      "Version bitsets",
+      find_command_versions(vindex->cmds, "print", 5) == 3 &&
+      find_command_versions(vindex->cmds, "pi", 2) == 2 &&
+      find_command_versions(vindex->cmds, "quit", 4) == 0 &&
+      find_symbol_versions(&vindex->settings, "logging enabled") == 2 &&
+      find_symbol_versions(&vindex->vars, "_exitcode") == 3,
+      "Version bitset mismatch"
+    );
+
+  /* Test selecting versions */
+  TEST_CASE(
+      "Select versions",
+      select_versions(vindex, "15") && vindex->selected == 2 &&
+      !select_versions(vindex, "12") &&
+      select_versions(vindex, NULL) && vindex->selected == 3,
+      "Version selection mismatch"
+    );
+
+  /* Test reporting incompatibilities */
+  insert_line(&data.linemap, "pipe print $_shell_exitcode | cat", 1);
+  insert_line(&data.linemap, "set print pretty on; print $_exitcode", 2);
+
+  struct args args = { 0 };
+  FILE *devnull = fopen("/dev/null", "w");
+
+  TEST_CASE(
+      "Report incompatibilities",
+      report_incompatible(&data, &args, devnull) == 2,
+      "Incompatibility count mismatch"
+    );
+
+  /* Test python and document bodies are not checked */
+  data.linemap.count = 0;
+  insert_line(&data.linemap, "python", 1);
+  insert_line(&data.linemap, "pipe = 2", 2);
+  insert_line(&data.linemap, "end", 3);
+  insert_line(&data.linemap, "document helper", 4);
+  insert_line(&data.linemap, "pipe the output to a shell", 5);
+  insert_line(&data.linemap, "end", 6);
+  insert_line(&data.linemap, "pipe print 1 | cat", 7);
+
+  TEST_CASE(
+      "Skip python and document bodies",
+      report_incompatible(&data, &args, devnull) == 1,
+      "Block body reported as incompatible"
+    );
+
+  fclose(devnull);
+  free(data.linemap.lines);
+  destroy_progdata(&data);
+  unlink(old);
+  unlink(new);
+
+  return 0;
+}